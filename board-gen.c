@@ -0,0 +1,61 @@
+/*
+ * board-gen - generate the compile-time wiring of a board
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+
+#include "board.h"
+
+/*
+ * Prints board-static.h for the board given on the command line, from
+ * its description in board.c, so that backends can be built with its
+ * CCLK/DATA pins and register layout as constants (make BOARD=<name>).
+ * RST is only driven a few times per session, it stays a runtime setting.
+ */
+int main(int argc, char **argv)
+{
+	const struct board *board;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: board-gen <board>\n");
+		return 1;
+	}
+
+	board = board_find(argv[1]);
+	if (!board) {
+		fprintf(stderr, "unknown board: %s, supported boards:\n", argv[1]);
+		for (board = boards; board->name; board++)
+			fprintf(stderr, "\t%-12s %s\n", board->name, board->desc);
+		return 1;
+	}
+
+	printf("/* Generated by board-gen from the \"%s\" board, do not edit */\n", board->name);
+	printf("#ifndef __CC2530PROG_BOARD_STATIC_H\n");
+	printf("#define __CC2530PROG_BOARD_STATIC_H\n\n");
+
+	printf("#define BOARD_STATIC_NAME\t\t\"%s\"\n", board->name);
+	printf("#define BOARD_STATIC_CCLK\t\t%d\n", board->cclk);
+	printf("#define BOARD_STATIC_DATA\t\t%d\n", board->data);
+	printf("#define BOARD_STATIC_SOC\t\t%d\n", board->soc);
+
+	/* the register layout, for the preprocessor */
+	switch (board->soc) {
+	case BOARD_SOC_BCM2835:
+		printf("#define BOARD_STATIC_BCM2835\t\t1\n");
+		break;
+	case BOARD_SOC_AM335X:
+		printf("#define BOARD_STATIC_AM335X\t\t1\n");
+		break;
+	default:
+		break;
+	}
+
+	printf("\n#endif /* __CC2530PROG_BOARD_STATIC_H */\n");
+
+	return 0;
+}
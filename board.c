@@ -0,0 +1,121 @@
+/*
+ * Board descriptions
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "board.h"
+#ifdef BOARD_STATIC
+#include "board-static.h"
+#endif
+
+const struct board boards[] = {
+	{
+		.name		= "generic",
+		.desc		= "GPIO 0/1/2, inverted reset (default)",
+		.rst		= 0,
+		.rst_active_low	= true,
+		.cclk		= 1,
+		.data		= 2,
+		.chip		= "/dev/gpiochip0",
+		.spidev		= "/dev/spidev0.0",
+	}, {
+		/*
+		 * RST on header pin 18, CCLK on pin 16, DATA on pin 15,
+		 * SPI0 SCLK (pin 23) and MOSI (pin 19) for the spidev transport
+		 */
+		.name		= "rpi",
+		.desc		= "Raspberry Pi 1/Zero (BCM2835)",
+		.rst		= 24,
+		.cclk		= 23,
+		.data		= 22,
+		.chip		= "/dev/gpiochip0",
+		.spidev		= "/dev/spidev0.0",
+		.soc		= BOARD_SOC_BCM2835,
+		.base		= { 0x20200000 },
+	}, {
+		.name		= "rpi2",
+		.desc		= "Raspberry Pi 2/3 (BCM2836/BCM2837)",
+		.rst		= 24,
+		.cclk		= 23,
+		.data		= 22,
+		.chip		= "/dev/gpiochip0",
+		.spidev		= "/dev/spidev0.0",
+		.soc		= BOARD_SOC_BCM2835,
+		.base		= { 0x3F200000 },
+	}, {
+		.name		= "rpi4",
+		.desc		= "Raspberry Pi 4 (BCM2711)",
+		.rst		= 24,
+		.cclk		= 23,
+		.data		= 22,
+		.chip		= "/dev/gpiochip0",
+		.spidev		= "/dev/spidev0.0",
+		.soc		= BOARD_SOC_BCM2835,
+		.base		= { 0xFE200000 },
+	}, {
+		/* RST on P9_12 (GPIO1_28), CCLK on P9_15 (GPIO1_16), DATA on P9_23 (GPIO1_17) */
+		.name		= "beaglebone",
+		.desc		= "BeagleBone (AM335x)",
+		.rst		= 60,
+		.cclk		= 48,
+		.data		= 49,
+		.soc		= BOARD_SOC_AM335X,
+		.base		= { 0x44E07000, 0x4804C000, 0x481AC000, 0x481AE000 },
+	}, {
+		/* CCLK on ADBUS0, DATA on ADBUS1 tied to ADBUS2, RST on ADBUS4 */
+		.name		= "ft2232h",
+		.desc		= "FT2232H MPSSE adapter, channel A",
+		.rst		= 4,
+		.cclk		= 0,
+		.data		= 1,
+		.usb_vid	= 0x0403,
+		.usb_pid	= 0x6010,
+	}, {
+		.name		= "ft232h",
+		.desc		= "FT232H MPSSE adapter",
+		.rst		= 4,
+		.cclk		= 0,
+		.data		= 1,
+		.usb_vid	= 0x0403,
+		.usb_pid	= 0x6014,
+	},
+	{ .name = NULL },
+};
+
+const struct board *board_find(const char *name)
+{
+	const struct board *board;
+
+	for (board = boards; board->name; board++) {
+		if (!strcmp(board->name, name))
+			return board;
+	}
+
+	return NULL;
+}
+
+/* the board the tree was built for (make BOARD=<name>), else the first one */
+const struct board *board_default(void)
+{
+#ifdef BOARD_STATIC
+	return board_find(BOARD_STATIC_NAME);
+#else
+	return &boards[0];
+#endif
+}
+
+void board_show_list(void)
+{
+	const struct board *board;
+
+	printf("Supported boards:\n");
+	for (board = boards; board->name; board++)
+		printf("\t%-12s %s\n", board->name, board->desc);
+}
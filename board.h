@@ -0,0 +1,49 @@
+#ifndef __CC2530PROG_BOARD_H
+#define __CC2530PROG_BOARD_H
+
+#include <stdbool.h>
+
+/* GPIO controller register layouts known by the gpio-mmap backend */
+enum board_soc {
+	BOARD_SOC_NONE,
+	BOARD_SOC_BCM2835,	/* BCM2835/2836/2837/2711 */
+	BOARD_SOC_AM335X,
+};
+
+#define BOARD_MAX_BANKS		4
+
+/*
+ * Board description: how the CC2530 debug port is wired, using the
+ * GPIO numbering of the backend, and where the GPIO controller lives.
+ */
+struct board {
+	const char *name;
+	const char *desc;
+
+	int rst;
+	bool rst_active_low;
+	int cclk;
+	int data;
+
+	/* GPIO character device (gpio-cdev) */
+	const char *chip;
+
+	/* SPI controller wired to CCLK/DATA (spidev transport) */
+	const char *spidev;
+
+	/* USB IDs of the MPSSE adapter (gpio-ftdi) */
+	unsigned short usb_vid;
+	unsigned short usb_pid;
+
+	/* GPIO controller physical address, one per bank of 32 GPIOs (gpio-mmap) */
+	enum board_soc soc;
+	unsigned long base[BOARD_MAX_BANKS];
+};
+
+extern const struct board boards[];
+
+const struct board *board_find(const char *name);
+const struct board *board_default(void);
+void board_show_list(void);
+
+#endif /* __CC2530PROG_BOARD_H */
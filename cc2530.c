@@ -0,0 +1,2954 @@
+/*
+ * libcc2530 - Texas Instruments CC2530 programming library
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "cc2530.h"
+#include "gpio.h"
+#include "image.h"
+#include "rt.h"
+#include "timing.h"
+#include "trace.h"
+
+#define ARRAY_SIZE(x)		(sizeof((x)) / sizeof((x[0])))
+#define DIV_ROUND_UP(n,d)	(((n) + (d) - 1) / (d))
+
+/*
+ * Debug command descriptor, the descriptors are never modified: the length
+ * of the variable commands is given when they are sent
+ */
+struct cc2530_cmd {
+	const char *name;
+	uint8_t	id;
+	uint8_t in;
+	uint8_t out;
+};
+
+/* how long the chip may take to get ready for an answer */
+#define READY_TIMEOUT_MS	100
+
+/*
+ * Expected duration of the slow operations, from the CC2530 datasheet (or
+ * the cycle count of the CRC routine): the host sleeps through most of it
+ * before polling the chip, with an exponential back-off, up to a deadline.
+ */
+enum cc2530_op {
+	OP_CHIP_ERASE,
+	OP_PAGE_ERASE,
+	OP_FLASH_WRITE,		/* per 4 byte flash word */
+	OP_XOSC_START,
+	OP_CRC,			/* per 2KB page */
+};
+
+static const struct cc2530_latency {
+	unsigned long expected_us;
+	unsigned long timeout_ms;
+} latencies[] = {
+	[OP_CHIP_ERASE]		= { 20000,	1000 },
+	[OP_PAGE_ERASE]		= { 20000,	1000 },
+	[OP_FLASH_WRITE]	= { 20,		1000 },
+	[OP_XOSC_START]		= { 300,	100 },
+	[OP_CRC]		= { 8000,	2000 },
+};
+
+/*
+ * Debug clock limit, 0 is as fast as the backend goes. It is halved each
+ * time the chip fails to answer a handshake, starting from BACKOFF_CLOCK_HZ
+ * when it was not limited, down to CC2530_MIN_CLOCK_HZ. Like the backend
+ * it drives, it is shared by all the contexts.
+ */
+#define BACKOFF_CLOCK_HZ	1000000
+
+static unsigned long clock_hz;
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the GPIO backend is initialized by the first context opened, then shared */
+static const struct board *backend_board;
+static unsigned int backend_users;
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Command queue: debug commands are queued with their parameters and
+ * where to store the answer, then sent to the backend in one go when
+ * the queue is flushed (or full). Answers are only valid after the
+ * flush, so only commands whose parameters do not depend on a previous
+ * answer of the same batch can be queued together.
+ */
+#define CMD_QUEUE_LEN		256
+
+struct cc2530_queue {
+	struct gpio_xfer xfer[CMD_QUEUE_LEN];
+	unsigned char request[CMD_QUEUE_LEN][4];
+	unsigned char answer[CMD_QUEUE_LEN][2];
+	unsigned int count;
+};
+
+/*
+ * Benchmark statistics: the time spent in each phase of the programming
+ * and the traffic it generated. "gpio_calls" counts the calls made to
+ * the GPIO backend (a whole burst shift-out or a command batch counts
+ * as one), "bytes" the bytes clocked on the debug link, not including
+ * the ready-wait polls.
+ */
+static const char * const phase_names[CC2530_NUM_PHASES] = {
+	[CC2530_PHASE_ENTER_DEBUG]	= "enter_debug",
+	[CC2530_PHASE_IDENTIFY]		= "identify",
+	[CC2530_PHASE_SETUP]		= "setup",
+	[CC2530_PHASE_COMPARE]		= "compare",
+	[CC2530_PHASE_ERASE]		= "erase",
+	[CC2530_PHASE_PROGRAM]		= "program",
+	[CC2530_PHASE_VERIFY]		= "verify",
+};
+
+struct cc2530_counters {
+	uint64_t ns;
+	uint64_t bytes;
+	unsigned long gpio_calls;
+};
+
+struct cc2530_stats {
+	struct cc2530_counters phase[CC2530_NUM_PHASES];
+	/* running totals, phases are accounted as differences */
+	uint64_t bytes;
+	unsigned long gpio_calls;
+	/* debug commands sent, indexed by command id >> 3 */
+	unsigned long cmds[32];
+	/* programming resumed after a failed block */
+	unsigned long retries;
+	/* programming time of each block */
+	unsigned long blocks;
+	uint64_t block_ns, block_min_ns, block_max_ns;
+};
+
+/*
+ * Gang programming: when the backend can clock several targets in
+ * lock-step, the burst writes of all the targets are gathered and sent
+ * together, each clock edge being shared by all of them. Every target
+ * waits for the others to reach their next burst write, or to leave the
+ * group once they have no more blocks to program.
+ */
+struct cc2530_gang {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int active;
+	unsigned int waiting;
+	unsigned long generation;
+	int ret;
+
+	size_t len;
+	int cclk[CC2530_MAX_TARGETS];
+	int data[CC2530_MAX_TARGETS];
+	const uint8_t *buf[CC2530_MAX_TARGETS];
+};
+
+/*
+ * A chip wired to its own RST/CCLK/DATA triplet, with all the state
+ * needed to talk to it, several targets can be programmed concurrently
+ */
+struct cc2530_target {
+	struct cc2530_ctx *ctx;
+	unsigned int index;
+	int rst;
+	bool rst_active_low;
+	int cclk;
+	int data;
+
+	unsigned debug_enabled;
+	int flash_size;
+	struct cc2530_queue queue;
+	struct cc2530_stats stats;
+
+	/* lock-step burst writes with the other targets, if not NULL */
+	struct cc2530_gang *gang;
+
+	pthread_t thread;
+	/* CPU of the thread, with the realtime option */
+	int cpu;
+
+	/* checkpoint of a full programming: the flash below it is programmed */
+	bool checkpointing;
+	uint32_t checkpoint;
+	uint32_t image_crc;
+	uint8_t ext_addr[8];
+
+	/* patches of the context image for this target, if not NULL */
+	const struct image *overlay;
+	/* part of cc2530_program() and cc2530_verify() */
+	bool enabled;
+	int result;
+};
+
+struct cc2530_ctx {
+	const struct board *board;
+	struct cc2530_options opts;
+	unsigned int block_size;
+
+	/* image being programmed or verified */
+	const struct image *img;
+	int (*run)(struct cc2530_target *t);
+
+	/* what only depends on the prepared image: its CRC-32 and page CRCs */
+	const struct image *prepared;
+	uint32_t prepared_crc;
+	uint16_t *page_crcs;
+
+	struct cc2530_target targets[CC2530_MAX_TARGETS];
+	unsigned int num_targets;
+	struct cc2530_gang gang;
+};
+
+#define CMD_ERASE		0x10
+#define CMD_WR_CFG		0x18
+#define CMD_RD_CFG		0x20
+#define CMD_GET_PC		0x28
+#define CMD_RD_ST		0x30
+#define CMD_SET_BRK		0x38
+#define CMD_HALT		0x40
+#define CMD_RESUME		0x48
+#define CMD_DBG_INST		0x50
+#define CMD_STEP_INST		0x58
+#define CMD_GET_BM		0x60
+#define CMD_GET_CHIP		0x68
+#define CMD_BURST_WR		0x80
+
+/* Various chip statuses */
+#define STACK_OVF		0x01
+#define OSC_STABLE		0x02
+#define DBG_LOCKED		0x04
+#define HALT_STATUS		0x08
+#define PWR_MODE_0		0x10
+#define CPU_HALTED		0x20
+#define PCON_IDLE		0x40
+#define CHIP_ERASE_BSY		0x80
+
+#define FCTL_BUSY		0x80
+#define FCTL_ERASE		0x01
+
+/* IDs that we recognize */
+#define CC2530_ID		0xA5
+
+/* Buffers */
+#define ADDR_BUF0		0x0000 /* 2 blocks, up to 4K */
+#define ADDR_DMA_DESC		0x1000 /* 32 bytes */
+#define ADDR_CRC_CODE		0x1C00 /* 256 bytes */
+#define ADDR_CRC_RESULT		0x1D00 /* 2 bytes per page + done marker */
+
+/* DMA Channels */
+#define CH_DBG_TO_BUF0	 	0x02
+#define CH_DBG_TO_BUF1	 	0x04
+#define CH_BUF0_TO_FLASH 	0x08
+#define CH_BUF1_TO_FLASH 	0x10
+
+#define LOBYTE(w) ((uint8_t)(w))
+#define HIBYTE(w) ((uint8_t)(((uint16_t)(w) >> 8) & 0xFF))
+
+/*
+ * Register offsets from ioCC2530.h
+ * make sure that these are always extended registers (16-bits addr)
+ * otherwise this simply will not work.
+ */
+#define X_EXT_ADDR_BASE	0x616A
+#define DBGDATA		0x6260
+#define FCTL		0x6270
+#define FADDRL		0x6271
+#define FADDRH		0x6272
+#define FWDATA		0x6273
+#define X_CHIPINFO0	0x6276
+#define X_CHIPINFO1	0x6277
+
+#define X_MEMCTR	0x70C7
+#define MEMCTR_XMAP	0x08	/* SRAM mapped in CODE at 0x8000 */
+#define MPAGE		0x93	/* SFR, high byte of MOVX @Ri */
+#define X_DMA1CFGH	0x70D3
+#define X_DMA1CFGL	0x70D4
+#define X_DMAARM	0x70D6
+
+#define X_CLKCONCMD	0x70C6
+#define X_CLKCONSTA	0x709E
+
+/*
+ * DMA descriptors, generated for the programming block size in use:
+ * channels 1 and 2 move burst writes from the debug interface to the
+ * buffers, channels 3 and 4 move the buffers to the flash controller.
+ */
+static void dma_desc_fill(uint8_t *desc, uint16_t src, uint16_t dest,
+			  uint16_t len, uint8_t trigger, uint8_t flags)
+{
+	desc[0] = HIBYTE(src);		/* src[15:8] */
+	desc[1] = LOBYTE(src);		/* src[7:0] */
+	desc[2] = HIBYTE(dest);		/* dest[15:8] */
+	desc[3] = LOBYTE(dest);		/* dest[7:0] */
+	desc[4] = HIBYTE(len);
+	desc[5] = LOBYTE(len);
+	desc[6] = trigger;
+	desc[7] = flags;
+}
+
+static void cc2530_setup_dma_desc(uint8_t *dma_desc, uint16_t block_size)
+{
+	uint16_t buf1 = ADDR_BUF0 + block_size;
+
+	/* Debug Interface -> Buffer 0 (Channel 1), trigger DBG_BW, increment destination */
+	dma_desc_fill(&dma_desc[0], DBGDATA, ADDR_BUF0, block_size, 31, 0x11);
+	/* Debug Interface -> Buffer 1 (Channel 2) */
+	dma_desc_fill(&dma_desc[8], DBGDATA, buf1, block_size, 31, 0x11);
+	/* Buffer 0 -> Flash controller (Channel 3), trigger FLASH, increment source */
+	dma_desc_fill(&dma_desc[16], ADDR_BUF0, FWDATA, block_size, 18, 0x42);
+	/* Buffer 1 -> Flash controller (Channel 4) */
+	dma_desc_fill(&dma_desc[24], buf1, FWDATA, block_size, 18, 0x42);
+}
+
+/* Outside of the image segments, flash is left erased */
+static inline uint8_t get_flash_byte(struct cc2530_target *t, uint32_t addr)
+{
+	uint8_t byte = image_get_byte(t->ctx->img, addr);
+
+	if (t->overlay)
+		image_overlay(t->overlay, addr, &byte, 1);
+
+	return byte;
+}
+
+/* the image of a target is the context one, patched by its overlay */
+static bool target_image_is_blank(struct cc2530_target *t, uint32_t addr, uint32_t len)
+{
+	return image_is_blank(t->ctx->img, addr, len) &&
+	       (!t->overlay || image_is_blank(t->overlay, addr, len));
+}
+
+static uint32_t target_image_end(struct cc2530_target *t)
+{
+	uint32_t end = image_end(t->ctx->img);
+
+	if (t->overlay && image_end(t->overlay) > end)
+		end = image_end(t->overlay);
+
+	return end;
+}
+
+/*
+ * Prepare the burst write command of the block at addr
+ */
+static void cc2530_pack_block(struct cc2530_target *t, unsigned char *block, uint32_t addr)
+{
+	unsigned int block_size = t->ctx->block_size;
+
+	/* 11-bit byte count, 0 stands for 2048 */
+	block[0] = CMD_BURST_WR | (HIBYTE(block_size) & 0x07);
+	block[1] = LOBYTE(block_size);
+
+	image_read(t->ctx->img, addr, &block[2], block_size);
+	if (t->overlay)
+		image_overlay(t->overlay, addr, &block[2], block_size);
+}
+
+static inline void bytes_to_bits(uint8_t byte)
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		if (byte & (1 << i))
+			printf("1");
+		else
+			printf("0");
+	}
+}
+
+/* indexed by command id >> 3, see find_cmd_by_id() */
+static const struct cc2530_cmd cc2530_commands[32] = {
+	[CMD_ERASE >> 3] = {
+		.name	= "erase",
+		.id	= CMD_ERASE,
+		.in	= 0,
+		.out	= 1,
+	},
+	[CMD_WR_CFG >> 3] = {
+		.name	= "write_config",
+		.id	= CMD_WR_CFG,
+		.in	= 1,
+		.out	= 1,
+	},
+	[CMD_RD_CFG >> 3] = {
+		.name	= "read_config",
+		.id	= CMD_RD_CFG,
+		.in	= 0,
+		.out	= 1,
+	},
+	[CMD_GET_PC >> 3] = {
+		.name	= "get_pc",
+		.id	= CMD_GET_PC,
+		.in	= 0,
+		.out	= 2,
+	},
+	[CMD_RD_ST >> 3] = {
+		.name	= "read_status",
+		.id	= CMD_RD_ST,
+		.in	= 0,
+		.out	= 1,
+	},
+	[CMD_HALT >> 3] = {
+		.name	= "halt",
+		.id	= CMD_HALT,
+		.in	= 0,
+		.out	= 1,
+	},
+	[CMD_RESUME >> 3] = {
+		.name	= "resume",
+		.id	= CMD_RESUME,
+		.in	= 0,
+		.out	= 1,
+	},
+	[CMD_DBG_INST >> 3] = {
+		.name	= "debug_inst",
+		.id	= CMD_DBG_INST,
+		.in	= -1,		/* variable */
+		.out	= 1,
+	},
+	[CMD_STEP_INST >> 3] = {
+		.name	= "step_inst",
+		.id	= CMD_STEP_INST,
+		.in	= 0,
+		.out	= 1,
+	},
+	[CMD_GET_BM >> 3] = {
+		.name	= "get_bm",
+		.id	= CMD_GET_BM,
+		.in	= 0,
+		.out	= 1,
+	},
+	[CMD_GET_CHIP >> 3] = {
+		.name	= "get_chip_id",
+		.id	= CMD_GET_CHIP,
+		.in	= 0,
+		.out	= 2,
+	},
+	[CMD_BURST_WR >> 3] = {
+		.name	= "burst_write",
+		.id	= CMD_BURST_WR,
+		.in	= -1,		/* variable */
+		.out	= 1,
+	},
+};
+
+/* the id is a constant everywhere but for user commands, this folds away */
+static inline const struct cc2530_cmd *find_cmd_by_id(uint8_t id)
+{
+	return &cc2530_commands[id >> 3];
+}
+
+static const struct cc2530_cmd *find_cmd_by_name(const char *name)
+{
+	int len = strlen(name);
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(cc2530_commands); i++) {
+		if (cc2530_commands[i].name &&
+		    !strncmp(cc2530_commands[i].name, name, len))
+			return &cc2530_commands[i];
+	}
+
+	return NULL;
+}
+
+void cc2530_show_command_list(void)
+{
+	unsigned int i;
+
+	printf("Supported commands:\n");
+	for (i = 0; i < ARRAY_SIZE(cc2530_commands); i++) {
+		if (cc2530_commands[i].name)
+			printf("\t%s\n", cc2530_commands[i].name);
+	}
+}
+
+void cc2530_trace_dump(void)
+{
+	const char *names[TRACE_NUM_CMDS];
+	unsigned int i;
+
+	for (i = 0; i < TRACE_NUM_CMDS; i++)
+		names[i] = cc2530_commands[i].name;
+
+	trace_dump(stderr, names);
+}
+
+static void cc2530_phase_start(struct cc2530_target *t, struct cc2530_counters *mark)
+{
+	mark->ns = timing_now_ns();
+	mark->bytes = t->stats.bytes;
+	mark->gpio_calls = t->stats.gpio_calls;
+}
+
+static void cc2530_phase_end(struct cc2530_target *t, enum cc2530_phase phase,
+			     const struct cc2530_counters *mark)
+{
+	struct cc2530_counters *c = &t->stats.phase[phase];
+
+	c->ns += timing_now_ns() - mark->ns;
+	c->bytes += t->stats.bytes - mark->bytes;
+	c->gpio_calls += t->stats.gpio_calls - mark->gpio_calls;
+}
+
+static inline void cc2530_count(struct cc2530_target *t, unsigned long gpio_calls,
+				uint64_t bytes)
+{
+	t->stats.gpio_calls += gpio_calls;
+	t->stats.bytes += bytes;
+}
+
+static inline void cc2530_count_cmd(struct cc2530_target *t, const struct cc2530_cmd *cmd)
+{
+	t->stats.cmds[cmd->id >> 3]++;
+}
+
+static void cc2530_count_block(struct cc2530_target *t, uint64_t ns)
+{
+	struct cc2530_stats *s = &t->stats;
+
+	if (!s->blocks || ns < s->block_min_ns)
+		s->block_min_ns = ns;
+	if (ns > s->block_max_ns)
+		s->block_max_ns = ns;
+	s->block_ns += ns;
+	s->blocks++;
+}
+
+/* bits clocked per second, and backend calls per byte */
+static double bench_rate(const struct cc2530_counters *c)
+{
+	return c->ns ? c->bytes * 8 * 1e9 / c->ns : 0;
+}
+
+static double bench_calls(const struct cc2530_counters *c)
+{
+	return c->bytes ? (double)c->gpio_calls / c->bytes : 0;
+}
+
+static void cc2530_bench_total(const struct cc2530_target *t, struct cc2530_counters *total)
+{
+	unsigned int i;
+
+	memset(total, 0, sizeof(*total));
+	for (i = 0; i < CC2530_NUM_PHASES; i++) {
+		total->ns += t->stats.phase[i].ns;
+		total->bytes += t->stats.phase[i].bytes;
+		total->gpio_calls += t->stats.phase[i].gpio_calls;
+	}
+}
+
+static void cc2530_bench_text(const struct cc2530_target *t)
+{
+	const struct cc2530_stats *s = &t->stats;
+	const struct cc2530_counters *c;
+	struct cc2530_counters total;
+	unsigned int i;
+
+	printf("target %d (RST %d, CCLK %d, DATA %d):\n", t->index, t->rst, t->cclk, t->data);
+	printf("\t%-12s %10s %10s %12s %10s\n", "phase", "ms", "bytes", "bits/s", "calls/B");
+
+	cc2530_bench_total(t, &total);
+	for (i = 0; i <= CC2530_NUM_PHASES; i++) {
+		c = i < CC2530_NUM_PHASES ? &s->phase[i] : &total;
+		if (!c->ns)
+			continue;
+		printf("\t%-12s %10.3f %10llu %12.0f %10.3f\n",
+			i < CC2530_NUM_PHASES ? phase_names[i] : "total", c->ns / 1e6,
+			(unsigned long long)c->bytes, bench_rate(c), bench_calls(c));
+	}
+
+	if (s->blocks)
+		printf("\tblocks: %lu, %.3f/%.3f/%.3f ms min/avg/max\n", s->blocks,
+			s->block_min_ns / 1e6, s->block_ns / 1e6 / s->blocks,
+			s->block_max_ns / 1e6);
+	if (s->retries)
+		printf("\tretries: %lu\n", s->retries);
+
+	printf("\tcommands:");
+	for (i = 0; i < ARRAY_SIZE(cc2530_commands); i++) {
+		if (s->cmds[i])
+			printf(" %s=%lu", cc2530_commands[i].name, s->cmds[i]);
+	}
+	printf("\n");
+}
+
+static void bench_json_counters(const char *name, const struct cc2530_counters *c,
+				bool last)
+{
+	printf("\t\t\t\t\"%s\": { \"ns\": %llu, \"bytes\": %llu, \"gpio_calls\": %lu, "
+		"\"bits_per_sec\": %.0f, \"gpio_calls_per_byte\": %.3f }%s\n",
+		name, (unsigned long long)c->ns, (unsigned long long)c->bytes,
+		c->gpio_calls, bench_rate(c), bench_calls(c), last ? "" : ",");
+}
+
+static void cc2530_bench_json(const struct cc2530_target *t, bool last)
+{
+	const struct cc2530_stats *s = &t->stats;
+	struct cc2530_counters total;
+	bool first = true;
+	unsigned int i;
+
+	printf("\t\t{\n");
+	printf("\t\t\t\"index\": %d, \"rst\": %d, \"cclk\": %d, \"data\": %d, "
+		"\"result\": %d,\n", t->index, t->rst, t->cclk, t->data, t->result);
+
+	printf("\t\t\t\"phases\": {\n");
+	for (i = 0; i < CC2530_NUM_PHASES; i++)
+		bench_json_counters(phase_names[i], &s->phase[i], false);
+	cc2530_bench_total(t, &total);
+	bench_json_counters("total", &total, true);
+	printf("\t\t\t},\n");
+
+	printf("\t\t\t\"blocks\": { \"count\": %lu, \"min_ns\": %llu, "
+		"\"avg_ns\": %llu, \"max_ns\": %llu, \"retries\": %lu },\n", s->blocks,
+		(unsigned long long)s->block_min_ns,
+		(unsigned long long)(s->blocks ? s->block_ns / s->blocks : 0),
+		(unsigned long long)s->block_max_ns, s->retries);
+
+	printf("\t\t\t\"commands\": {");
+	for (i = 0; i < ARRAY_SIZE(cc2530_commands); i++) {
+		if (!cc2530_commands[i].name)
+			continue;
+		printf("%s \"%s\": %lu", first ? "" : ",", cc2530_commands[i].name,
+			s->cmds[i]);
+		first = false;
+	}
+	printf(" }\n");
+
+	printf("\t\t}%s\n", last ? "" : ",");
+}
+
+#define __stringify_1(x)	#x
+#define __stringify(x)		__stringify_1(x)
+
+static unsigned long cc2530_clock(void);
+
+void cc2530_bench_report(const struct cc2530_ctx *ctx, bool json, uint64_t gpio_init_ns)
+{
+	unsigned int i;
+
+	if (!json) {
+		printf("Benchmark: backend %s, board %s, clock %lu Hz, block size %d\n",
+			__stringify(GPIO_BACKEND), ctx->board->name, cc2530_clock(),
+			ctx->block_size);
+		printf("\tgpio_init: %.3f ms\n", gpio_init_ns / 1e6);
+		for (i = 0; i < ctx->num_targets; i++)
+			cc2530_bench_text(&ctx->targets[i]);
+		return;
+	}
+
+	printf("{\n");
+	printf("\t\"backend\": \"%s\",\n", __stringify(GPIO_BACKEND));
+	printf("\t\"board\": \"%s\",\n", ctx->board->name);
+	printf("\t\"clock_hz\": %lu,\n", cc2530_clock());
+	printf("\t\"block_size\": %d,\n", ctx->block_size);
+	printf("\t\"gpio_init_ns\": %llu,\n", (unsigned long long)gpio_init_ns);
+	printf("\t\"targets\": [\n");
+	for (i = 0; i < ctx->num_targets; i++)
+		cc2530_bench_json(&ctx->targets[i], i + 1 == ctx->num_targets);
+	printf("\t]\n");
+	printf("}\n");
+}
+
+/*
+ * Perform GPIO initialization, the backend is only initialized for the
+ * first context, then shared
+ */
+static int cc2530_gpio_init(struct cc2530_ctx *ctx)
+{
+	unsigned long hz = ctx->opts.clock_hz;
+	int ret = 0;
+
+	pthread_mutex_lock(&backend_lock);
+
+	if (backend_users && backend_board != ctx->board) {
+		fprintf(stderr, "GPIO backend already in use by board %s\n",
+			backend_board->name);
+		ret = -1;
+		goto out;
+	}
+
+	if (!backend_users) {
+		ret = gpio_init(ctx->board);
+		if (ret) {
+			fprintf(stderr, "failed to initialize GPIO backend\n");
+			goto out;
+		}
+
+		ret = gpio_transport_init(ctx->board);
+		if (ret) {
+			fprintf(stderr, "failed to initialize transport\n");
+			gpio_exit();
+			goto out;
+		}
+
+		backend_board = ctx->board;
+	}
+
+	if (hz) {
+		pthread_mutex_lock(&clock_lock);
+		ret = gpio_set_clock(hz);
+		if (!ret)
+			clock_hz = hz;
+		pthread_mutex_unlock(&clock_lock);
+
+		if (ret) {
+			fprintf(stderr, "failed to set the debug clock to %lu Hz\n", hz);
+			if (!backend_users) {
+				gpio_transport_exit();
+				gpio_exit();
+			}
+			goto out;
+		}
+
+		if (ctx->opts.verbose)
+			printf("Debug clock: %lu Hz\n", hz);
+	}
+
+	backend_users++;
+out:
+	pthread_mutex_unlock(&backend_lock);
+	return ret;
+}
+
+/*
+ * Export the GPIOs of a target, serialized with the other contexts as
+ * the backends reorganize their exported GPIOs
+ */
+static int cc2530_target_init(struct cc2530_target *t)
+{
+	const int gpios[] = { t->rst, t->cclk, t->data };
+	int ret = 0;
+	unsigned int i;
+
+	pthread_mutex_lock(&backend_lock);
+
+	for (i = 0; i < ARRAY_SIZE(gpios); i++) {
+		ret = gpio_export(gpios[i]);
+		if (ret) {
+			fprintf(stderr, "failed to export %d\n", gpios[i]);
+			break;
+		}
+
+		ret = gpio_set_direction(gpios[i], GPIO_DIRECTION_OUT);
+		if (ret) {
+			fprintf(stderr, "failed to set direction on %d\n", gpios[i]);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&backend_lock);
+
+	return ret;
+}
+
+/*
+ * Put back GPIOs in a sane state
+ */
+static int cc2530_target_deinit(struct cc2530_target *t)
+{
+	const int gpios[] = { t->rst, t->cclk, t->data };
+	int ret = 0;
+	unsigned int i;
+
+	pthread_mutex_lock(&backend_lock);
+
+	for (i = 0; i < ARRAY_SIZE(gpios); i++) {
+		ret = gpio_set_direction(gpios[i], GPIO_DIRECTION_IN);
+		if (ret) {
+			fprintf(stderr, "failed to set direction on %d\n", gpios[i]);
+			break;
+		}
+
+		ret = gpio_unexport(gpios[i]);
+		if (ret) {
+			fprintf(stderr, "failed to unexport %d\n", gpios[i]);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&backend_lock);
+
+	return ret;
+}
+
+static void cc2530_gpio_deinit(void)
+{
+	pthread_mutex_lock(&backend_lock);
+	if (!--backend_users) {
+		gpio_transport_exit();
+		gpio_exit();
+		backend_board = NULL;
+	}
+	pthread_mutex_unlock(&backend_lock);
+}
+
+/*
+ * Drive the reset line, taking the board polarity into account
+ */
+static inline void cc2530_set_reset(struct cc2530_target *t, bool value)
+{
+	gpio_set_value(t->rst, t->rst_active_low ? !value : value);
+	cc2530_count(t, 1, 0);
+}
+
+/*
+ * Hold reset low while raising clock twice
+ */
+static int cc2530_enter_debug(struct cc2530_target *t)
+{
+	int i;
+
+	/* pulse RST low */
+	cc2530_set_reset(t, 0);
+
+	for (i = 0; i < 2; i++) {
+		gpio_set_value(t->cclk, 0);
+		gpio_set_value(t->cclk, 1);
+	}
+
+	/* Keep clock low */
+	gpio_set_value(t->cclk, 0);
+	cc2530_count(t, 5, 0);
+
+	/* pulse Reset high */
+	cc2530_set_reset(t, 1);
+
+	t->debug_enabled = 1;
+
+	return 0;
+}
+
+static int cc2530_leave_debug(struct cc2530_target *t)
+{
+	cc2530_set_reset(t, 0);
+	cc2530_set_reset(t, 1);
+
+	t->debug_enabled = 0;
+
+	return 0;
+}
+
+/*
+ * Enter debug mode unless the target is already in it
+ */
+static void cc2530_ensure_debug(struct cc2530_target *t)
+{
+	struct cc2530_counters mark;
+
+	if (t->debug_enabled)
+		return;
+
+	cc2530_phase_start(t, &mark);
+	cc2530_enter_debug(t);
+	cc2530_phase_end(t, CC2530_PHASE_ENTER_DEBUG, &mark);
+}
+
+/*
+ * Lower the debug clock after a failed handshake at failed_hz, unless
+ * another target already did. Returns -1 when it cannot go any lower.
+ */
+static int cc2530_clock_backoff(struct cc2530_target *t, unsigned long failed_hz)
+{
+	unsigned long hz;
+	int ret = 0;
+
+	pthread_mutex_lock(&clock_lock);
+
+	if (clock_hz != failed_hz)
+		goto out;
+
+	hz = clock_hz ? clock_hz / 2 : BACKOFF_CLOCK_HZ;
+	if (hz < CC2530_MIN_CLOCK_HZ) {
+		ret = -1;
+		goto out;
+	}
+
+	ret = gpio_set_clock(hz);
+	if (ret) {
+		fprintf(stderr, "failed to set the debug clock to %lu Hz\n", hz);
+		goto out;
+	}
+
+	clock_hz = hz;
+	if (t->ctx->opts.verbose)
+		printf("Debug clock lowered to %lu Hz\n", hz);
+out:
+	pthread_mutex_unlock(&clock_lock);
+	return ret;
+}
+
+static unsigned long cc2530_clock(void)
+{
+	unsigned long hz;
+
+	pthread_mutex_lock(&clock_lock);
+	hz = clock_hz;
+	pthread_mutex_unlock(&clock_lock);
+
+	return hz;
+}
+
+/*
+ * Start waiting for count times op, elapsed_us of which have already
+ * been spent since the chip was told to start it
+ */
+static void cc2530_wait_start(struct timing_deadline *d, enum cc2530_op op,
+			      unsigned int count, unsigned long elapsed_us)
+{
+	unsigned long expected_us = latencies[op].expected_us * count;
+
+	timing_wait_start(d, expected_us > elapsed_us ? expected_us - elapsed_us : 0,
+			  latencies[op].timeout_ms);
+}
+
+/*
+ * Send a command with its cmd->in bytes of parameters, the answer is read
+ * straight into outbuf (cmd->out bytes, not valid on failure)
+ */
+static int cc2530_do_cmd(struct cc2530_target *t, const struct cc2530_cmd *cmd,
+			 const unsigned char *params, unsigned char *outbuf)
+{
+	unsigned char request[4];
+	int ret;
+
+	if (cmd->in > sizeof(request) - 1) {
+		fprintf(stderr, "invalid command length: %d\n", cmd->in);
+		return -1;
+	}
+
+	request[0] = cmd->id;
+
+	/* If there is any command payload also send it */
+	if (cmd->in)
+		memcpy(&request[1], params, cmd->in);
+
+	/*
+	 * Send the request, then wait for the chip to be ready and read
+	 * the answer
+	 */
+	ret = gpio_transaction(t->cclk, t->data, request, 1 + cmd->in,
+			       outbuf, cmd->out, READY_TIMEOUT_MS);
+	cc2530_count_cmd(t, cmd);
+	cc2530_count(t, 1, 1 + cmd->in + cmd->out);
+	trace_cmd(cmd->id, TRACE_ISSUED);
+	trace_xfer(t->cclk, request, 1 + cmd->in, outbuf, cmd->out, ret);
+	if (ret == -ETIMEDOUT) {
+		trace_cmd(cmd->id, TRACE_TIMEDOUT);
+		fprintf(stderr, "timed out waiting for chip to be ready again\n");
+	} else if (ret)
+		fprintf(stderr, "failed to send command\n");
+
+	return ret;
+}
+
+static int cc2530_queue_flush(struct cc2530_target *t)
+{
+	unsigned int i;
+	int ret;
+
+	if (!t->queue.count)
+		return 0;
+
+	ret = gpio_transactions(t->cclk, t->data, t->queue.xfer,
+				t->queue.count, READY_TIMEOUT_MS);
+
+	cc2530_count(t, 1, 0);
+	for (i = 0; i < t->queue.count; i++) {
+		cc2530_count(t, 0, t->queue.xfer[i].out_len + t->queue.xfer[i].in_len);
+		trace_xfer(t->cclk, t->queue.xfer[i].out, t->queue.xfer[i].out_len,
+			   t->queue.xfer[i].in, t->queue.xfer[i].in_len, ret);
+	}
+
+	if (ret == -ETIMEDOUT) {
+		/* which command of the batch timed out is not known, blame the first */
+		trace_cmd(t->queue.xfer[0].out[0], TRACE_TIMEDOUT);
+		fprintf(stderr, "timed out waiting for chip to be ready again\n");
+	} else if (ret)
+		fprintf(stderr, "failed to send %d queued commands\n", t->queue.count);
+
+	t->queue.count = 0;
+
+	return ret;
+}
+
+/*
+ * Queue a command with len bytes of parameters, the answer is stored
+ * in outbuf (if not NULL) once the queue has been flushed.
+ */
+static int cc2530_queue_cmd(struct cc2530_target *t, const struct cc2530_cmd *cmd,
+			    const unsigned char *params, uint8_t len, unsigned char *outbuf)
+{
+	struct gpio_xfer *xfer;
+	unsigned char *request;
+	int ret;
+
+	if (len > sizeof(t->queue.request[0]) - 1 ||
+	    cmd->out > sizeof(t->queue.answer[0])) {
+		fprintf(stderr, "invalid command length: %d\n", len);
+		return -1;
+	}
+
+	if (t->queue.count == CMD_QUEUE_LEN) {
+		ret = cc2530_queue_flush(t);
+		if (ret)
+			return ret;
+	}
+
+	request = t->queue.request[t->queue.count];
+	xfer = &t->queue.xfer[t->queue.count];
+
+	if (cmd->id == CMD_DBG_INST)
+		request[0] = cmd->id | len;
+	else
+		request[0] = cmd->id;
+	memcpy(&request[1], params, len);
+
+	xfer->out = request;
+	xfer->out_len = 1 + len;
+	xfer->in = outbuf ? outbuf : t->queue.answer[t->queue.count];
+	xfer->in_len = cmd->out;
+	xfer->wait = false;
+
+	t->queue.count++;
+	cc2530_count_cmd(t, cmd);
+	trace_cmd(cmd->id, TRACE_ISSUED);
+
+	return 0;
+}
+
+/*
+ * Queue a burst write of a block prepared with cc2530_pack_block(), the
+ * block must stay untouched until the queue has been flushed.
+ */
+static int cc2530_queue_burst(struct cc2530_target *t, const unsigned char *block)
+{
+	struct gpio_xfer *xfer;
+	int ret;
+
+	if (t->queue.count == CMD_QUEUE_LEN) {
+		ret = cc2530_queue_flush(t);
+		if (ret)
+			return ret;
+	}
+
+	xfer = &t->queue.xfer[t->queue.count];
+	xfer->out = block;
+	xfer->out_len = 2 + t->ctx->block_size;
+	xfer->in = t->queue.answer[t->queue.count];
+	xfer->in_len = 1;
+	xfer->wait = true;
+
+	t->queue.count++;
+	t->stats.cmds[CMD_BURST_WR >> 3]++;
+	trace_cmd(CMD_BURST_WR, TRACE_ISSUED);
+
+	return 0;
+}
+
+static int cc2530_queue_write_xdata(struct cc2530_target *t, uint16_t addr, uint8_t value)
+{
+	const struct cc2530_cmd *cmd = find_cmd_by_id(CMD_DBG_INST);
+	unsigned char instr[3];
+	int ret;
+
+	/* MOV DPTR, #addr */
+	instr[0] = 0x90;
+	instr[1] = HIBYTE(addr);
+	instr[2] = LOBYTE(addr);
+	ret = cc2530_queue_cmd(t, cmd, instr, 3, NULL);
+
+	/* MOV A, #value */
+	instr[0] = 0x74;
+	instr[1] = value;
+	ret |= cc2530_queue_cmd(t, cmd, instr, 2, NULL);
+
+	/* MOVX @DPTR, A */
+	instr[0] = 0xF0;
+	ret |= cc2530_queue_cmd(t, cmd, instr, 1, NULL);
+
+	return ret;
+}
+
+static int cc2530_queue_read_xdata(struct cc2530_target *t, uint16_t addr, unsigned char *result)
+{
+	const struct cc2530_cmd *cmd = find_cmd_by_id(CMD_DBG_INST);
+	unsigned char instr[3];
+	int ret;
+
+	/* MOV DPTR, #addr */
+	instr[0] = 0x90;
+	instr[1] = HIBYTE(addr);
+	instr[2] = LOBYTE(addr);
+	ret = cc2530_queue_cmd(t, cmd, instr, 3, NULL);
+
+	/* MOVX A, @DPTR */
+	instr[0] = 0xE0;
+	ret |= cc2530_queue_cmd(t, cmd, instr, 1, result);
+
+	return ret;
+}
+
+static int cc2530_chip_erase(struct cc2530_target *t)
+{
+	const struct cc2530_cmd *cmd;
+	int ret;
+	unsigned char result;
+	struct timing_deadline d;
+
+	cmd = find_cmd_by_id(CMD_ERASE);
+	ret = cc2530_do_cmd(t, cmd, NULL, &result);
+	if (ret) {
+		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
+		return ret;
+	}
+
+	cc2530_wait_start(&d, OP_CHIP_ERASE, 1, 0);
+
+	cmd = find_cmd_by_id(CMD_RD_ST);
+	for (;;) {
+		ret = cc2530_do_cmd(t, cmd, NULL, &result);
+		if (ret) {
+			fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
+			return ret;
+		}
+
+		if (!(result & CHIP_ERASE_BSY))
+			return 0;
+
+		if (timing_wait_poll(&d)) {
+			fprintf(stderr, "timeout waiting for the chip to be erased\n");
+			return -1;
+		}
+	}
+}
+
+static int cc2530_write_xdata_memory(struct cc2530_target *t, uint16_t addr, uint8_t value)
+{
+	const struct cc2530_cmd *cmd;
+	int ret;
+
+	cmd = find_cmd_by_id(CMD_DBG_INST);
+
+	ret = cc2530_queue_write_xdata(t, addr, value);
+	if (!ret)
+		ret = cc2530_queue_flush(t);
+	if (ret) {
+		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Queue the read of num_bytes consecutive XDATA bytes: DPTR is set once,
+ * then each byte is one MOVX and one INC DPTR
+ */
+static int cc2530_queue_read_xdata_block(struct cc2530_target *t, uint16_t addr,
+					 unsigned char *values, uint16_t num_bytes)
+{
+	const struct cc2530_cmd *cmd = find_cmd_by_id(CMD_DBG_INST);
+	unsigned char instr[3];
+	uint16_t i;
+	int ret;
+
+	/* MOV DPTR, #addr */
+	instr[0] = 0x90;
+	instr[1] = HIBYTE(addr);
+	instr[2] = LOBYTE(addr);
+	ret = cc2530_queue_cmd(t, cmd, instr, 3, NULL);
+
+	for (i = 0; i < num_bytes && !ret; i++) {
+		/* MOVX A, @DPTR */
+		instr[0] = 0xE0;
+		ret = cc2530_queue_cmd(t, cmd, instr, 1, &values[i]);
+
+		/* INC DPTR, not needed after the last byte */
+		instr[0] = 0xA3;
+		if (!ret && i + 1 < num_bytes)
+			ret = cc2530_queue_cmd(t, cmd, instr, 1, NULL);
+	}
+
+	return ret;
+}
+
+static int cc2530_read_xdata_memory_block(struct cc2530_target *t, uint16_t addr,
+					  unsigned char *values, uint16_t num_bytes)
+{
+	int ret;
+
+	ret = cc2530_queue_read_xdata_block(t, addr, values, num_bytes);
+	if (!ret)
+		ret = cc2530_queue_flush(t);
+	if (ret) {
+		fprintf(stderr, "%s: failed to read %d bytes at %04x\n", __func__,
+			num_bytes, addr);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int cc2530_read_xdata_memory(struct cc2530_target *t, uint16_t addr, unsigned char *result)
+{
+	const struct cc2530_cmd *cmd;
+	int ret;
+
+	cmd = find_cmd_by_id(CMD_DBG_INST);
+
+	ret = cc2530_queue_read_xdata(t, addr, result);
+	if (!ret)
+		ret = cc2530_queue_flush(t);
+	if (ret) {
+		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int cc2530_write_xdata_memory_block(struct cc2530_target *t,
+				uint16_t addr, const uint8_t *values, uint16_t num_bytes)
+{
+	const struct cc2530_cmd *cmd;
+	int ret;
+	unsigned char instr[3];
+	uint16_t i;
+
+	cmd = find_cmd_by_id(CMD_DBG_INST);
+
+	/* MOV DPTR, #addr */
+	instr[0] = 0x90;
+	instr[1] = HIBYTE(addr);
+	instr[2] = LOBYTE(addr);
+	ret = cc2530_queue_cmd(t, cmd, instr, 3, NULL);
+	if (ret) {
+		fprintf(stderr, "failed to issue: %s\n", cmd->name);
+		return ret;
+	}
+
+	for (i = 0; i < num_bytes; i++) {
+		/* MOV A, #value */
+		instr[0] = 0x74;
+		instr[1] = values[i];
+		ret = cc2530_queue_cmd(t, cmd, instr, 2, NULL);
+		if (ret)
+			break;
+
+		/* MOVX @DPTR, A */
+		instr[0] = 0xF0;
+		ret = cc2530_queue_cmd(t, cmd, instr, 1, NULL);
+		if (ret)
+			break;
+
+		/* INC DPTR */
+		instr[0] = 0xA3;
+		ret = cc2530_queue_cmd(t, cmd, instr, 1, NULL);
+		if (ret)
+			break;
+	}
+
+	if (!ret)
+		ret = cc2530_queue_flush(t);
+	if (ret) {
+		fprintf(stderr, "failed to issue: %s at %i\n", cmd->name, i);
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Read flash through the 32KB XDATA window at 0x8000, selecting the
+ * bank with MEMCTR. The debug interface has no burst read, each byte
+ * costs a MOVX A,@DPTR and an INC DPTR, but DPTR is only set once per
+ * bank and the instructions of a whole block are queued back to back.
+ */
+#define FLASH_BANK_SIZE		(32 * 1024)
+#define XDATA_FLASH_WINDOW	0x8000
+
+static int cc2530_flash_read(struct cc2530_target *t, uint32_t addr,
+			     unsigned char *buf, uint32_t len)
+{
+	uint32_t offset, chunk;
+	int ret;
+
+	/* one block read per flash bank window */
+	for (; len; addr += chunk, buf += chunk, len -= chunk) {
+		offset = addr % FLASH_BANK_SIZE;
+		chunk = FLASH_BANK_SIZE - offset;
+		if (chunk > len)
+			chunk = len;
+
+		ret = cc2530_queue_write_xdata(t, X_MEMCTR, addr / FLASH_BANK_SIZE);
+		if (!ret)
+			ret = cc2530_queue_read_xdata_block(t, XDATA_FLASH_WINDOW + offset,
+							    buf, chunk);
+		if (ret) {
+			fprintf(stderr, "%s: failed to read at %06x\n", __func__, addr);
+			return ret;
+		}
+	}
+
+	ret = cc2530_queue_flush(t);
+	if (ret)
+		fprintf(stderr, "%s: failed to read flash\n", __func__);
+
+	return ret;
+}
+
+/*
+ * Read the flash back and compare it with the image, num_bytes_ok is
+ * set to the number of bytes verified correct before the first mismatch
+ */
+static int cc2530_flash_verify(struct cc2530_target *t, uint32_t max_addr,
+			       uint32_t *num_bytes_ok)
+{
+	unsigned char buf[1024];
+	unsigned char expected;
+	uint32_t addr = 0;
+	uint32_t bad = 0, first_bad = 0;
+	uint32_t i, len;
+	int ret;
+
+	for (addr = 0; addr < max_addr; addr += len) {
+		if (t->ctx->opts.verbose && (addr % FLASH_BANK_SIZE) == 0)
+			printf("Reading bank: %d\n", addr / FLASH_BANK_SIZE);
+
+		len = max_addr - addr;
+		if (len > sizeof(buf))
+			len = sizeof(buf);
+
+		/* only read back what was programmed */
+		if (target_image_is_blank(t, addr, len))
+			continue;
+
+		ret = cc2530_flash_read(t, addr, buf, len);
+		if (ret) {
+			fprintf(stderr, "%s: read failed at %u\n", __func__, addr);
+			return ret;
+		}
+
+		for (i = 0; i < len; i++) {
+			expected = get_flash_byte(t, addr + i);
+			if (buf[i] != expected) {
+				printf("[bank%d][%d], result: %02x, expected: %02x\n",
+					(addr + i) / FLASH_BANK_SIZE,
+					(addr + i) % FLASH_BANK_SIZE, buf[i], expected);
+				if (!bad++)
+					first_bad = addr + i;
+			}
+		}
+	}
+
+	*num_bytes_ok = bad ? first_bad : addr;
+
+	return 0;
+}
+
+/*
+ * On-chip CRC: a small routine is loaded in SRAM, mapped in CODE space
+ * through MEMCTR.XMAP, and computes the CRC16 (CCITT, 0x1021, initial
+ * value 0xFFFF, MSB first) of consecutive 2KB flash pages read through
+ * the XDATA window. It is entered with DPTR pointing to the first page,
+ * R4 holding the number of pages and MPAGE:R0 pointing to the result
+ * area, which receives the CRCs (MSB first) followed by a done marker.
+ */
+#define FLASH_PAGE_SIZE		2048
+#define FLASH_MAX_PAGES		(256 * 1024 / FLASH_PAGE_SIZE)
+#define CRC_DONE		0xA5
+
+static const uint8_t crc_code[] = {
+	/* page_loop: */
+	0x7E, 0xFF,		/* MOV R6, #0FFh	crc = 0xFFFF */
+	0x7F, 0xFF,		/* MOV R7, #0FFh */
+	0x7A, 0x08,		/* MOV R2, #08h		2048 bytes */
+	0x7B, 0x00,		/* MOV R3, #00h */
+	/* byte_loop: */
+	0xE0,			/* MOVX A, @DPTR */
+	0xA3,			/* INC DPTR */
+	0x6E,			/* XRL A, R6		crc ^= byte << 8 */
+	0xFE,			/* MOV R6, A */
+	0x7D, 0x08,		/* MOV R5, #8 */
+	/* bit_loop: */
+	0xC3,			/* CLR C		crc <<= 1 */
+	0xEF,			/* MOV A, R7 */
+	0x33,			/* RLC A */
+	0xFF,			/* MOV R7, A */
+	0xEE,			/* MOV A, R6 */
+	0x33,			/* RLC A */
+	0xFE,			/* MOV R6, A */
+	0x50, 0x08,		/* JNC no_xor */
+	0xEF,			/* MOV A, R7		crc ^= 0x1021 */
+	0x64, 0x21,		/* XRL A, #21h */
+	0xFF,			/* MOV R7, A */
+	0xEE,			/* MOV A, R6 */
+	0x64, 0x10,		/* XRL A, #10h */
+	0xFE,			/* MOV R6, A */
+	/* no_xor: */
+	0xDD, 0xED,		/* DJNZ R5, bit_loop */
+	0xEB,			/* MOV A, R3		R2:R3-- */
+	0x70, 0x01,		/* JNZ skip */
+	0x1A,			/* DEC R2 */
+	/* skip: */
+	0x1B,			/* DEC R3 */
+	0xEB,			/* MOV A, R3 */
+	0x4A,			/* ORL A, R2 */
+	0x70, 0xDE,		/* JNZ byte_loop */
+	0xEE,			/* MOV A, R6		store the CRC */
+	0xF2,			/* MOVX @R0, A */
+	0x08,			/* INC R0 */
+	0xEF,			/* MOV A, R7 */
+	0xF2,			/* MOVX @R0, A */
+	0x08,			/* INC R0 */
+	0xDC, 0xCE,		/* DJNZ R4, page_loop */
+	0x74, CRC_DONE,		/* MOV A, #CRC_DONE */
+	0xF2,			/* MOVX @R0, A */
+	0x80, 0xFE,		/* SJMP $ */
+};
+
+static uint16_t crc16_ccitt(uint16_t crc, uint8_t byte)
+{
+	int i;
+
+	crc ^= byte << 8;
+	for (i = 0; i < 8; i++)
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+
+	return crc;
+}
+
+static int cc2530_queue_inst(struct cc2530_target *t, const unsigned char *instr, uint8_t len)
+{
+	return cc2530_queue_cmd(t, find_cmd_by_id(CMD_DBG_INST), instr, len, NULL);
+}
+
+/*
+ * Run the CRC routine over the first num_pages pages of a bank
+ */
+static int cc2530_flash_crc(struct cc2530_target *t, uint8_t bank,
+			    uint8_t num_pages, uint16_t *crcs)
+{
+	const uint16_t code_addr = XDATA_FLASH_WINDOW + ADDR_CRC_CODE;
+	const uint16_t end_addr = code_addr + sizeof(crc_code) - 2;
+	const uint16_t done_addr = ADDR_CRC_RESULT + 2 * num_pages;
+	unsigned char instr[3];
+	unsigned char pc[2];
+	unsigned char raw[2 * FLASH_BANK_SIZE / FLASH_PAGE_SIZE];
+	unsigned char result;
+	struct timing_deadline d;
+	int ret;
+	int i;
+
+	ret = cc2530_write_xdata_memory(t, done_addr, 0);
+	if (ret)
+		return ret;
+
+	ret = cc2530_write_xdata_memory(t, X_MEMCTR, MEMCTR_XMAP | bank);
+	if (ret)
+		return ret;
+
+	/* MOV DPTR, #8000h */
+	instr[0] = 0x90;
+	instr[1] = HIBYTE(XDATA_FLASH_WINDOW);
+	instr[2] = LOBYTE(XDATA_FLASH_WINDOW);
+	cc2530_queue_inst(t, instr, 3);
+
+	/* MOV R4, #num_pages */
+	instr[0] = 0x7C;
+	instr[1] = num_pages;
+	cc2530_queue_inst(t, instr, 2);
+
+	/* MOV R0, #LOW(result) */
+	instr[0] = 0x78;
+	instr[1] = LOBYTE(ADDR_CRC_RESULT);
+	cc2530_queue_inst(t, instr, 2);
+
+	/* MOV MPAGE, #HIGH(result) */
+	instr[0] = 0x75;
+	instr[1] = MPAGE;
+	instr[2] = HIBYTE(ADDR_CRC_RESULT);
+	cc2530_queue_inst(t, instr, 3);
+
+	/* LJMP code_addr */
+	instr[0] = 0x02;
+	instr[1] = HIBYTE(code_addr);
+	instr[2] = LOBYTE(code_addr);
+	cc2530_queue_inst(t, instr, 3);
+
+	ret = cc2530_queue_flush(t);
+	if (ret) {
+		fprintf(stderr, "%s: failed to set up the CRC routine\n", __func__);
+		return ret;
+	}
+
+	/*
+	 * Let it run and watch the program counter until it spins on its
+	 * final SJMP $: halting it and reading the marker through
+	 * MOV DPTR / MOVX would clobber the DPTR and A of the running loop.
+	 */
+	ret = cc2530_do_cmd(t, find_cmd_by_id(CMD_RESUME), NULL, &result);
+	if (ret)
+		return ret;
+
+	cc2530_wait_start(&d, OP_CRC, num_pages, 0);
+
+	for (;;) {
+		ret = cc2530_do_cmd(t, find_cmd_by_id(CMD_GET_PC), NULL, pc);
+		if (ret)
+			return ret;
+
+		if (((pc[0] << 8) | pc[1]) == end_addr)
+			break;
+
+		if (timing_wait_poll(&d)) {
+			fprintf(stderr, "%s: timeout computing CRC of bank %d\n", __func__, bank);
+			cc2530_do_cmd(t, find_cmd_by_id(CMD_HALT), NULL, &result);
+			return -1;
+		}
+	}
+
+	ret = cc2530_do_cmd(t, find_cmd_by_id(CMD_HALT), NULL, &result);
+	if (ret)
+		return ret;
+
+	ret = cc2530_read_xdata_memory(t, done_addr, &result);
+	if (ret)
+		return ret;
+
+	if (result != CRC_DONE) {
+		fprintf(stderr, "%s: CRC routine of bank %d did not complete\n", __func__, bank);
+		return -1;
+	}
+
+	ret = cc2530_read_xdata_memory_block(t, ADDR_CRC_RESULT, raw, 2 * num_pages);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < num_pages; i++)
+		crcs[i] = (raw[2 * i] << 8) | raw[2 * i + 1];
+
+	return 0;
+}
+
+/*
+ * Compute the CRCs of the first num_pages flash pages, bank by bank
+ */
+static int cc2530_flash_crcs(struct cc2530_target *t, unsigned int num_pages, uint16_t *crcs)
+{
+	const unsigned int pages_per_bank = FLASH_BANK_SIZE / FLASH_PAGE_SIZE;
+	unsigned int bank, n;
+	int ret;
+
+	ret = cc2530_write_xdata_memory_block(t, ADDR_CRC_CODE, crc_code, sizeof(crc_code));
+	if (ret) {
+		fprintf(stderr, "%s: failed to load the CRC routine\n", __func__);
+		return ret;
+	}
+
+	for (bank = 0; bank * pages_per_bank < num_pages; bank++) {
+		n = num_pages - bank * pages_per_bank;
+		if (n > pages_per_bank)
+			n = pages_per_bank;
+
+		if (t->ctx->opts.verbose)
+			printf("Checking bank: %d\n", bank);
+
+		ret = cc2530_flash_crc(t, bank, n, crcs + bank * pages_per_bank);
+		if (ret) {
+			fprintf(stderr, "%s: failed to compute CRC of bank %d\n", __func__, bank);
+			return ret;
+		}
+	}
+
+	/* back to the reset mapping */
+	return cc2530_write_xdata_memory(t, X_MEMCTR, 0);
+}
+
+static uint16_t page_crc(const struct image *img, const struct image *overlay, uint32_t addr)
+{
+	uint8_t buf[FLASH_PAGE_SIZE];
+	uint16_t crc = 0xFFFF;
+	unsigned int i;
+
+	image_read(img, addr, buf, sizeof(buf));
+	if (overlay)
+		image_overlay(overlay, addr, buf, sizeof(buf));
+
+	for (i = 0; i < FLASH_PAGE_SIZE; i++)
+		crc = crc16_ccitt(crc, buf[i]);
+
+	return crc;
+}
+
+static uint16_t image_page_crc(struct cc2530_target *t, uint32_t addr)
+{
+	/* the prepared CRCs hold for the pages the overlay leaves alone */
+	if (t->ctx->img == t->ctx->prepared &&
+	    (!t->overlay || !image_overlaps(t->overlay, addr, FLASH_PAGE_SIZE)))
+		return t->ctx->page_crcs[addr / FLASH_PAGE_SIZE];
+
+	return page_crc(t->ctx->img, t->overlay, addr);
+}
+
+/*
+ * Verify flash by comparing on-chip page CRCs with the image, only the
+ * pages whose CRC differs are read back to report the differences
+ */
+static int cc2530_flash_verify_crc(struct cc2530_target *t, uint32_t max_addr,
+				   uint32_t *num_bytes_ok)
+{
+	unsigned int num_pages = DIV_ROUND_UP(max_addr, FLASH_PAGE_SIZE);
+	unsigned char buf[FLASH_PAGE_SIZE];
+	uint16_t crcs[FLASH_MAX_PAGES];
+	uint32_t bad = 0, first_bad = 0;
+	unsigned int page, i;
+	uint32_t addr;
+	uint16_t crc;
+	int ret;
+
+	ret = cc2530_flash_crcs(t, num_pages, crcs);
+	if (ret)
+		return ret;
+
+	for (page = 0; page < num_pages; page++) {
+		addr = page * FLASH_PAGE_SIZE;
+
+		crc = image_page_crc(t, addr);
+		if (crc == crcs[page])
+			continue;
+
+		if (t->ctx->opts.verbose)
+			printf("page %d: CRC %04x, expected %04x\n", page, crcs[page], crc);
+
+		ret = cc2530_flash_read(t, addr, buf, sizeof(buf));
+		if (ret) {
+			fprintf(stderr, "%s: read failed at %u\n", __func__, addr);
+			return ret;
+		}
+
+		for (i = 0; i < FLASH_PAGE_SIZE; i++) {
+			if (buf[i] == get_flash_byte(t, addr + i))
+				continue;
+
+			printf("[bank%d][%d], result: %02x, expected: %02x\n",
+				addr / FLASH_BANK_SIZE, addr % FLASH_BANK_SIZE + i,
+				buf[i], get_flash_byte(t, addr + i));
+			if (!bad++)
+				first_bad = addr + i;
+		}
+	}
+
+	*num_bytes_ok = bad ? first_bad : max_addr;
+
+	return 0;
+}
+
+static int cc2530_page_erase(struct cc2530_target *t, unsigned int page)
+{
+	unsigned char result;
+	struct timing_deadline d;
+	int ret;
+
+	/* FADDR is a word address, a page is 512 words */
+	ret = cc2530_write_xdata_memory(t, FADDRH, page << 1);
+	if (!ret)
+		ret = cc2530_write_xdata_memory(t, FADDRL, 0);
+	if (!ret)
+		ret = cc2530_write_xdata_memory(t, FCTL, FCTL_ERASE);
+	if (ret) {
+		fprintf(stderr, "%s: failed to erase page %d\n", __func__, page);
+		return ret;
+	}
+
+	cc2530_wait_start(&d, OP_PAGE_ERASE, 1, 0);
+
+	for (;;) {
+		ret = cc2530_read_xdata_memory(t, FCTL, &result);
+		if (ret) {
+			fprintf(stderr, "%s: failed to read FCTL\n", __func__);
+			return ret;
+		}
+
+		if (!(result & FCTL_BUSY))
+			return 0;
+
+		if (timing_wait_poll(&d)) {
+			fprintf(stderr, "%s: timeout erasing page %d\n", __func__, page);
+			return -1;
+		}
+	}
+}
+
+/* called with the lock held, once every active target is waiting */
+static void cc2530_gang_run(struct cc2530_gang *g)
+{
+	g->ret = gpio_gang_shift_out(g->cclk, g->data, g->buf, g->waiting, g->len);
+	g->waiting = 0;
+	g->generation++;
+	pthread_cond_broadcast(&g->cond);
+}
+
+static int cc2530_gang_shift_out(struct cc2530_target *t, const unsigned char *block)
+{
+	struct cc2530_gang *g = t->gang;
+	unsigned long generation;
+	unsigned int slot;
+	int ret;
+
+	pthread_mutex_lock(&g->lock);
+
+	slot = g->waiting++;
+	g->cclk[slot] = t->cclk;
+	g->data[slot] = t->data;
+	g->buf[slot] = block;
+	generation = g->generation;
+
+	if (g->waiting == g->active)
+		cc2530_gang_run(g);
+	else {
+		while (g->generation == generation)
+			pthread_cond_wait(&g->cond, &g->lock);
+	}
+
+	ret = g->ret;
+	pthread_mutex_unlock(&g->lock);
+
+	return ret;
+}
+
+static void cc2530_gang_leave(struct cc2530_target *t)
+{
+	struct cc2530_gang *g = t->gang;
+
+	if (!g)
+		return;
+
+	pthread_mutex_lock(&g->lock);
+	g->active--;
+	if (g->waiting && g->waiting == g->active)
+		cc2530_gang_run(g);
+	pthread_mutex_unlock(&g->lock);
+
+	t->gang = NULL;
+}
+
+/*
+ * Burst write a block in lock-step with the other targets, then wait for
+ * the chip to be ready and read its status like for any other command
+ */
+static int cc2530_gang_burst(struct cc2530_target *t, const unsigned char *block)
+{
+	unsigned char result;
+	int ret;
+
+	ret = gpio_set_direction(t->data, GPIO_DIRECTION_OUT);
+	if (!ret)
+		ret = cc2530_gang_shift_out(t, block);
+	if (!ret)
+		ret = gpio_transaction(t->cclk, t->data, NULL, 0, &result, 1, READY_TIMEOUT_MS);
+
+	t->stats.cmds[CMD_BURST_WR >> 3]++;
+	cc2530_count(t, 3, 2 + t->ctx->block_size + 1);
+	trace_cmd(CMD_BURST_WR, TRACE_ISSUED);
+	trace_xfer(t->cclk, block, 2 + t->ctx->block_size, &result, 1, ret);
+	if (ret == -ETIMEDOUT)
+		trace_cmd(CMD_BURST_WR, TRACE_TIMEDOUT);
+	if (ret)
+		fprintf(stderr, "%s: burst write failed\n", __func__);
+
+	return ret;
+}
+
+/*
+ * Checkpoint of a full programming, so that an interrupted session
+ * resumes instead of starting over: the flash below an address, on a
+ * page boundary, is programmed with the image. It only holds for the
+ * chip (by its IEEE address), image and block size it was written for.
+ */
+static void cc2530_checkpoint_path(struct cc2530_target *t, char *path, size_t len)
+{
+	if (t->ctx->num_targets > 1)
+		snprintf(path, len, "%s.%u", t->ctx->opts.checkpoint, t->index);
+	else
+		snprintf(path, len, "%s", t->ctx->opts.checkpoint);
+}
+
+static void cc2530_checkpoint_key(struct cc2530_target *t, char *key, size_t len)
+{
+	const uint8_t *a = t->ext_addr;
+
+	snprintf(key, len, "%08x %u %02x%02x%02x%02x%02x%02x%02x%02x", t->image_crc,
+		 t->ctx->block_size, a[7], a[6], a[5], a[4], a[3], a[2], a[1], a[0]);
+}
+
+/*
+ * Start checkpointing, returns where a previous session stopped, or 0
+ * if there is nothing to resume
+ */
+static uint32_t cc2530_checkpoint_load(struct cc2530_target *t)
+{
+	char path[PATH_MAX], key[64], line[128];
+	uint32_t addr = 0;
+	size_t len;
+	FILE *f;
+
+	t->checkpointing = t->ctx->opts.checkpoint != NULL;
+	t->checkpoint = 0;
+	if (!t->checkpointing)
+		return 0;
+
+	t->image_crc = t->ctx->img == t->ctx->prepared ? t->ctx->prepared_crc :
+			image_crc32(t->ctx->img);
+	if (t->overlay)
+		t->image_crc ^= image_crc32(t->overlay);
+	cc2530_checkpoint_key(t, key, sizeof(key));
+	cc2530_checkpoint_path(t, path, sizeof(path));
+
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	len = strlen(key);
+	if (fgets(line, sizeof(line), f) && !strncmp(line, key, len) && line[len] == ' ')
+		addr = strtoul(line + len + 1, NULL, 0);
+	else
+		fprintf(stderr, "%s: not for this chip and image, ignored\n", path);
+	fclose(f);
+
+	if (addr % FLASH_PAGE_SIZE || addr > (uint32_t)t->flash_size)
+		addr = 0;
+	t->checkpoint = addr;
+
+	return addr;
+}
+
+/*
+ * The checkpoint file may be older than the flash contents, trust it only
+ * if the pages before resume hold the image and the ones after the resume
+ * page, which is erased again, are still blank
+ */
+static bool cc2530_checkpoint_valid(struct cc2530_target *t, uint32_t resume)
+{
+	unsigned int num_pages = t->flash_size / FLASH_PAGE_SIZE;
+	unsigned int first = resume / FLASH_PAGE_SIZE;
+	uint16_t crcs[FLASH_MAX_PAGES];
+	uint16_t blank = 0xFFFF;
+	unsigned int page, i;
+
+	if (cc2530_flash_crcs(t, num_pages, crcs))
+		return false;
+
+	for (i = 0; i < FLASH_PAGE_SIZE; i++)
+		blank = crc16_ccitt(blank, 0xFF);
+
+	for (page = 0; page < num_pages; page++) {
+		if (page < first &&
+		    crcs[page] != image_page_crc(t, page * FLASH_PAGE_SIZE))
+			return false;
+		if (page > first && crcs[page] != blank)
+			return false;
+	}
+
+	return true;
+}
+
+/* record that the flash below done is programmed */
+static void cc2530_checkpoint_save(struct cc2530_target *t, uint32_t done)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 4], key[64];
+	FILE *f;
+	int ret;
+
+	done -= done % FLASH_PAGE_SIZE;
+	if (!t->checkpointing || done <= t->checkpoint)
+		return;
+
+	cc2530_checkpoint_key(t, key, sizeof(key));
+	cc2530_checkpoint_path(t, path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	/* replaced at once, an interruption leaves the previous one */
+	f = fopen(tmp, "w");
+	if (!f) {
+		perror(tmp);
+		t->checkpointing = false;
+		return;
+	}
+
+	ret = fprintf(f, "%s %#x\n", key, done) < 0;
+	ret |= fclose(f);
+	if (ret || rename(tmp, path)) {
+		fprintf(stderr, "failed to write checkpoint %s\n", path);
+		unlink(tmp);
+		t->checkpointing = false;
+		return;
+	}
+
+	t->checkpoint = done;
+}
+
+static void cc2530_checkpoint_remove(struct cc2530_target *t)
+{
+	char path[PATH_MAX];
+
+	if (!t->ctx->opts.checkpoint)
+		return;
+
+	cc2530_checkpoint_path(t, path, sizeof(path));
+	if (unlink(path) && errno != ENOENT)
+		perror(path);
+	t->checkpointing = false;
+}
+
+/*
+ * Program num_buffers blocks of the image starting at addr, which must
+ * be aligned on a flash word. On return, written is the number of blocks
+ * known to be programmed, the one after them may be partly programmed.
+ *
+ * Blocks are pipelined: each batch starts programming the previous
+ * block, DMAs the current one into the other buffer and reads FCTL
+ * back, the next block is packed while the flash controller is busy.
+ * FCTL is only polled again when the write of the previous block was
+ * still in progress after the burst, which is reported as a stall.
+ */
+static int cc2530_program_flash(struct cc2530_target *t, uint32_t addr, uint32_t num_buffers,
+				uint32_t *written)
+{
+	unsigned char block[2][2 + CC2530_MAX_BLOCK_SIZE];
+	uint8_t dma_desc[32];
+	unsigned int stalls = 0, polls, total_polls = 0;
+	struct timing_deadline d;
+	uint64_t start_ns, block_ns;
+	unsigned char result;
+	uint32_t i;
+	int ret;
+
+	*written = 0;
+
+	/* Write the 4 DMA descriptors */
+	cc2530_setup_dma_desc(dma_desc, t->ctx->block_size);
+	ret = cc2530_write_xdata_memory_block(t, ADDR_DMA_DESC, dma_desc, ARRAY_SIZE(dma_desc));
+	if (ret) {
+		fprintf(stderr, "%s: failed to write DMA descriptors\n", __func__);
+		return ret;
+	}
+
+	/* Set the pointer to the DMA descriptors */
+	ret = cc2530_write_xdata_memory(t, X_DMA1CFGH, HIBYTE(ADDR_DMA_DESC));
+	if (ret) {
+		fprintf(stderr, "%s: failed to set DMA descriptors (part 1)\n", __func__);
+		return ret;
+	}
+	ret = cc2530_write_xdata_memory(t, X_DMA1CFGL, LOBYTE(ADDR_DMA_DESC));
+	if (ret) {
+		fprintf(stderr, "%s: failed to set DMA descriptors (part 2)\n", __func__);
+		return ret;
+	}
+
+	/* FADDR is a word address, it auto-increments while writing */
+	ret = cc2530_write_xdata_memory(t, FADDRH, HIBYTE(addr >> 2));
+	if (ret) {
+		fprintf(stderr, "%s: failed to set FADDRH\n", __func__);
+		return ret;
+	}
+	ret = cc2530_write_xdata_memory(t, FADDRL, LOBYTE(addr >> 2));
+	if (ret) {
+		fprintf(stderr, "%s: failed to set FADDRL\n", __func__);
+		return ret;
+	}
+
+	cc2530_pack_block(t, block[0], addr);
+
+	for (i = 0; i <= num_buffers; i++) {
+		if (t->ctx->opts.progress && i < num_buffers)
+			t->ctx->opts.progress(t->ctx->opts.progress_arg, t->index, i, num_buffers);
+
+		block_ns = timing_now_ns();
+
+		/* start programming the previous buffer */
+		if (i > 0) {
+			ret = cc2530_queue_write_xdata(t, X_DMAARM, (i & 1) ?
+						CH_BUF0_TO_FLASH : CH_BUF1_TO_FLASH);
+			ret |= cc2530_queue_write_xdata(t, FCTL, 0x06);
+		}
+
+		/* transfer the current buffer while it is being written */
+		if (i < num_buffers) {
+			ret |= cc2530_queue_write_xdata(t, X_DMAARM, (i & 1) ?
+						CH_DBG_TO_BUF1 : CH_DBG_TO_BUF0);
+			if (!t->gang)
+				ret |= cc2530_queue_burst(t, block[i & 1]);
+			else if (!ret) {
+				ret = cc2530_queue_flush(t);
+				if (!ret)
+					ret = cc2530_gang_burst(t, block[i & 1]);
+			}
+		}
+
+		ret |= cc2530_queue_read_xdata(t, FCTL, &result);
+
+		start_ns = timing_now_ns();
+		if (!ret)
+			ret = cc2530_queue_flush(t);
+		if (ret) {
+			fprintf(stderr, "%s: failed at %i\n", __func__, i);
+			return ret;
+		}
+
+		/* the chip is busy with the flash, prepare the next block */
+		if (i + 1 < num_buffers)
+			cc2530_pack_block(t, block[(i + 1) & 1], addr + (i + 1) * t->ctx->block_size);
+
+		/* the write started with the batch, sleep through what is left */
+		if (result & FCTL_BUSY)
+			cc2530_wait_start(&d, OP_FLASH_WRITE, t->ctx->block_size / 4,
+					  (timing_now_ns() - start_ns) / 1000);
+
+		polls = 0;
+		while (result & FCTL_BUSY) {
+			if (timing_wait_poll(&d)) {
+				fprintf(stderr, "%s: timeout at %i\n", __func__, i);
+				return -1;
+			}
+
+			ret = cc2530_read_xdata_memory(t, FCTL, &result);
+			if (ret) {
+				fprintf(stderr, "%s: failed at %i\n", __func__, i);
+				return ret;
+			}
+			polls++;
+		}
+
+		/* the burst did not hide the write of the previous block */
+		if (polls && i > 0 && i < num_buffers) {
+			if (t->ctx->opts.verbose > 1)
+				printf("block %d: stalled for %d FCTL polls\n", i - 1, polls);
+			stalls++;
+			total_polls += polls;
+		}
+
+		/* each batch completes the write of the previous block */
+		if (i > 0) {
+			cc2530_count_block(t, timing_now_ns() - block_ns);
+			*written = i;
+			cc2530_checkpoint_save(t, addr + i * t->ctx->block_size);
+		}
+	}
+
+	if (t->ctx->opts.verbose && num_buffers > 1)
+		printf("Flash write stalls: %d of %d blocks (%d FCTL polls)\n",
+			stalls, num_buffers - 1, total_polls);
+
+	return 0;
+}
+
+/* attempts at programming a page after a failed block */
+#define PROGRAM_RETRIES		3
+
+static int cc2530_setup(struct cc2530_target *t);
+
+/*
+ * Get a target which failed in the middle of programming ready to go on
+ * from a page: back in debug mode, with DMA and the clock set up again,
+ * and that page erased as it may hold a partly programmed block
+ */
+static int cc2530_program_recover(struct cc2530_target *t, unsigned int page)
+{
+	struct timing_deadline d;
+	unsigned char result;
+	int ret;
+
+	t->queue.count = 0;
+	cc2530_enter_debug(t);
+
+	ret = cc2530_setup(t);
+	if (ret)
+		return ret;
+
+	/* the write of the failed block may still be in progress */
+	cc2530_wait_start(&d, OP_FLASH_WRITE, 0, 0);
+	for (;;) {
+		ret = cc2530_read_xdata_memory(t, FCTL, &result);
+		if (ret) {
+			fprintf(stderr, "%s: failed to read FCTL\n", __func__);
+			return ret;
+		}
+
+		if (!(result & FCTL_BUSY))
+			break;
+
+		if (timing_wait_poll(&d)) {
+			fprintf(stderr, "%s: timeout waiting for the flash\n", __func__);
+			return -1;
+		}
+	}
+
+	return cc2530_page_erase(t, page);
+}
+
+/*
+ * Program the flash range [addr, end), skipping the blocks which the
+ * image leaves blank: they are already erased, FADDR is simply moved
+ * to the next block holding data.
+ *
+ * When a block fails, programming resumes from the start of its page
+ * (the range is page aligned or starts at 0), a few times per page,
+ * instead of starting over.
+ */
+static int cc2530_program_range(struct cc2530_target *t, uint32_t addr, uint32_t end)
+{
+	unsigned int page, failed_page = UINT_MAX, retries = 0;
+	uint32_t start, written;
+	int ret;
+
+	while (addr < end) {
+		if (target_image_is_blank(t, addr, t->ctx->block_size)) {
+			addr += t->ctx->block_size;
+			continue;
+		}
+
+		start = addr;
+		while (addr < end && !target_image_is_blank(t, addr, t->ctx->block_size))
+			addr += t->ctx->block_size;
+
+		ret = cc2530_program_flash(t, start, (addr - start) / t->ctx->block_size,
+					   &written);
+		if (!ret)
+			continue;
+
+		page = (start + written * t->ctx->block_size) / FLASH_PAGE_SIZE;
+		if (page != failed_page) {
+			failed_page = page;
+			retries = PROGRAM_RETRIES;
+		}
+		if (!retries--)
+			return ret;
+
+		fprintf(stderr, "retrying from page %u\n", page);
+		trace_cmd(CMD_BURST_WR, TRACE_RETRIED);
+		t->stats.retries++;
+
+		ret = cc2530_program_recover(t, page);
+		if (ret)
+			return ret;
+		addr = page * FLASH_PAGE_SIZE;
+	}
+
+	return 0;
+}
+
+/*
+ * Only erase and rewrite the flash pages whose on-chip CRC does not match
+ * the image, pages past the end of the image are expected to be erased
+ */
+static int cc2530_update_flash(struct cc2530_target *t, uint32_t flash_size)
+{
+	unsigned int num_pages = flash_size / FLASH_PAGE_SIZE;
+	uint16_t crcs[FLASH_MAX_PAGES];
+	unsigned int page, first, changed = 0;
+	struct cc2530_counters mark;
+	uint32_t addr, end;
+	int ret;
+
+	cc2530_phase_start(t, &mark);
+	ret = cc2530_flash_crcs(t, num_pages, crcs);
+	cc2530_phase_end(t, CC2530_PHASE_COMPARE, &mark);
+	if (ret)
+		return ret;
+
+	for (page = 0; page < num_pages; page++) {
+		if (crcs[page] == image_page_crc(t, page * FLASH_PAGE_SIZE))
+			continue;
+
+		/* erase a run of changed pages, then program it at once */
+		first = page;
+		for (; page < num_pages; page++) {
+			if (crcs[page] == image_page_crc(t, page * FLASH_PAGE_SIZE))
+				break;
+
+			cc2530_phase_start(t, &mark);
+			ret = cc2530_page_erase(t, page);
+			cc2530_phase_end(t, CC2530_PHASE_ERASE, &mark);
+			if (ret)
+				return ret;
+			changed++;
+		}
+
+		addr = first * FLASH_PAGE_SIZE;
+		end = page * FLASH_PAGE_SIZE;
+
+		if (t->ctx->opts.verbose)
+			printf("Updating pages %d to %d\n", first, page - 1);
+
+		cc2530_phase_start(t, &mark);
+		ret = cc2530_program_range(t, addr, end);
+		cc2530_phase_end(t, CC2530_PHASE_PROGRAM, &mark);
+		if (ret)
+			return ret;
+	}
+
+	if (t->ctx->opts.verbose)
+		printf("%d of %d pages updated\n", changed, num_pages);
+
+	return 0;
+}
+
+void cc2530_print_info(const struct cc2530_info *info)
+{
+	printf("Texas Instruments CC2530 (ID: 0x%02x, rev 0x%02x)\n",
+		info->chip_id, info->revision);
+	printf("Extended addr: %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x\n",
+		info->ext_addr[7], info->ext_addr[6], info->ext_addr[5], info->ext_addr[4],
+		info->ext_addr[3], info->ext_addr[2], info->ext_addr[1], info->ext_addr[0]);
+	if (info->usb)
+		printf("USB available\n");
+	else
+		printf("USB: not availabe\n");
+	printf("Flash size: %u KB\n", info->flash_size / 1024);
+}
+
+static int cc2530_chip_identify(struct cc2530_target *t, struct cc2530_info *info)
+{
+	const struct cc2530_cmd *cmd;
+	int ret = 0;
+	unsigned char result[2] = { 0 };
+	unsigned char chipinfo[2];
+
+	memset(info, 0, sizeof(*info));
+
+	cmd = find_cmd_by_id(CMD_GET_CHIP);
+	ret = cc2530_do_cmd(t, cmd, NULL, result);
+	if (ret) {
+		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
+		goto out;
+	}
+
+	/* Check that we actually know that chip */
+	if (result[0] != CC2530_ID) {
+		fprintf(stderr, "unknown Chip ID: %02x\n", result[0]);
+		if (result[0] == 0xFF || result[0] == 0)
+			fprintf(stderr, "someone is holding the CLK/DATA lines against us "
+					"make sure no debugger is *connected*\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	info->chip_id = result[0];
+	info->revision = result[1];
+
+	/*
+	 * Do some chip identification, the extended address and CHIPINFO
+	 * registers are read in a single batch
+	 */
+	ret = cc2530_queue_read_xdata_block(t, X_EXT_ADDR_BASE, info->ext_addr, 7);
+	if (!ret)
+		ret = cc2530_queue_read_xdata_block(t, X_CHIPINFO0, chipinfo, 2);
+	if (!ret)
+		ret = cc2530_queue_flush(t);
+	if (ret) {
+		fprintf(stderr, "%s: failed to read X_EXTADDR and X_CHIPINFO\n", __func__);
+		return ret;
+	}
+
+	info->usb = chipinfo[0] & 8;
+
+	switch ((chipinfo[0] & 0x70) >> 4) {
+	case 1:
+		info->flash_size = 32;
+		break;
+	case 2:
+		info->flash_size = 64;
+		break;
+	case 3:
+		info->flash_size = 128;
+		break;
+	case 4:
+		info->flash_size = 256;
+	}
+
+	info->flash_size *= 1024;
+	t->flash_size = info->flash_size;
+
+	if (t->ctx->opts.verbose)
+		cc2530_print_info(info);
+out:
+	return ret;
+}
+
+/*
+ * Enable the DMA and switch to the 32MHz crystal oscillator
+ */
+static int cc2530_setup(struct cc2530_target *t)
+{
+	const struct cc2530_cmd *cmd;
+	int ret = 0;
+	unsigned char config;
+	unsigned char result;
+	struct timing_deadline d;
+	struct cc2530_counters mark;
+	unsigned int retry_cnt = 3;
+	unsigned long hz;
+
+	cc2530_phase_start(t, &mark);
+	for (;;) {
+		/* Enable DMA */
+		hz = cc2530_clock();
+		cmd = find_cmd_by_id(CMD_WR_CFG);
+		config = 0x22;
+		ret = cc2530_do_cmd(t, cmd, &config, &result);
+		if (ret) {
+			fprintf(stderr, "failed to enable DMA\n");
+			return ret;
+		}
+
+		if (result == config)
+			break;
+
+		/* a corrupted readback may come from a too fast clock */
+		if (cc2530_clock_backoff(t, hz) && !--retry_cnt) {
+			fprintf(stderr, "write config failed\n");
+			return -1;
+		}
+
+		fprintf(stderr, "write config failed, retrying\n");
+		trace_cmd(CMD_WR_CFG, TRACE_RETRIED);
+		cc2530_enter_debug(t);
+	}
+
+	ret = cc2530_write_xdata_memory(t, X_CLKCONCMD, 0x80);
+	if (ret) {
+		fprintf(stderr, "failed to write X_CLKCONCMD\n");
+		return ret;
+	}
+
+	cc2530_wait_start(&d, OP_XOSC_START, 1, 0);
+
+	for (;;) {
+		ret = cc2530_read_xdata_memory(t, X_CLKCONSTA, &result);
+		if (ret) {
+			fprintf(stderr, "%s: failed to read X_CLKCONSTA\n", __func__);
+			return ret;
+		}
+
+		if (result == 0x80)
+			break;
+
+		if (timing_wait_poll(&d)) {
+			fprintf(stderr, "%s: timeout waiting for CLKCONSTA\n", __func__);
+			return -1;
+		}
+	}
+
+	cc2530_phase_end(t, CC2530_PHASE_SETUP, &mark);
+
+	return 0;
+}
+
+/*
+ * Compare the flash with the image, up to the end of its last block
+ */
+static int cc2530_verify_target(struct cc2530_target *t)
+{
+	uint32_t end = DIV_ROUND_UP(target_image_end(t), t->ctx->block_size) *
+		       t->ctx->block_size;
+	uint32_t num_bytes_ok = 0;
+	struct cc2530_counters mark;
+	int ret;
+
+	cc2530_phase_start(t, &mark);
+	if (t->ctx->opts.crc)
+		ret = cc2530_flash_verify_crc(t, end, &num_bytes_ok);
+	else
+		ret = cc2530_flash_verify(t, end, &num_bytes_ok);
+	cc2530_phase_end(t, CC2530_PHASE_VERIFY, &mark);
+
+	if (ret) {
+		fprintf(stderr, "failed to read back the flash\n");
+		return ret;
+	}
+
+	if (num_bytes_ok != end) {
+		if (t->ctx->opts.verbose)
+			printf("Verification failed\n");
+		return -1;
+	}
+
+	if (t->ctx->opts.verbose)
+		printf("Verification OK\n");
+
+	return 0;
+}
+
+/*
+ * Perform full CC2530 chip initialization and programming
+ */
+static int cc2530_do_program(struct cc2530_target *t)
+{
+	struct cc2530_counters mark;
+	uint32_t blocks, resume;
+	int ret;
+
+	t->checkpointing = false;
+
+	ret = cc2530_setup(t);
+	if (ret)
+		return ret;
+
+	blocks = DIV_ROUND_UP(target_image_end(t), t->ctx->block_size);
+
+	if (t->ctx->opts.update) {
+		ret = cc2530_update_flash(t, t->flash_size);
+		if (ret) {
+			fprintf(stderr, "failed to update flash\n");
+			return ret;
+		}
+	} else {
+		/* a previous session stopped there, its page may be partly programmed */
+		resume = cc2530_checkpoint_load(t);
+		if (resume >= blocks * t->ctx->block_size)
+			resume = 0;
+		if (resume) {
+			cc2530_phase_start(t, &mark);
+			if (!cc2530_checkpoint_valid(t, resume)) {
+				fprintf(stderr, "flash does not match the checkpoint, starting over\n");
+				resume = 0;
+			}
+			cc2530_phase_end(t, CC2530_PHASE_COMPARE, &mark);
+		}
+		if (resume && t->ctx->opts.verbose)
+			printf("Resuming from 0x%05x\n", resume);
+
+		cc2530_phase_start(t, &mark);
+		if (resume)
+			ret = cc2530_page_erase(t, resume / FLASH_PAGE_SIZE);
+		else
+			ret = cc2530_chip_erase(t);
+		cc2530_phase_end(t, CC2530_PHASE_ERASE, &mark);
+		if (ret) {
+			fprintf(stderr, "failed to erase chip\n");
+			return ret;
+		}
+
+		cc2530_phase_start(t, &mark);
+		ret = cc2530_program_range(t, resume, blocks * t->ctx->block_size);
+		cc2530_phase_end(t, CC2530_PHASE_PROGRAM, &mark);
+		if (ret) {
+			fprintf(stderr, "failed to program flash\n");
+			return ret;
+		}
+	}
+
+	/* no more burst writes from this target */
+	cc2530_gang_leave(t);
+
+	if (t->ctx->opts.readback)
+		ret = cc2530_verify_target(t);
+
+	/* programmed, a verification failure starts over next time */
+	cc2530_checkpoint_remove(t);
+
+	cc2530_leave_debug(t);
+
+	return ret;
+}
+
+static int cc2530_do_verify(struct cc2530_target *t)
+{
+	int ret;
+
+	ret = cc2530_setup(t);
+	if (!ret)
+		ret = cc2530_verify_target(t);
+
+	cc2530_leave_debug(t);
+
+	return ret;
+}
+
+/*
+ * Identify a target, slowing the clock down when it does not answer
+ */
+static int cc2530_target_identify(struct cc2530_target *t, struct cc2530_info *info)
+{
+	struct cc2530_counters mark;
+	unsigned int retry_cnt = 3;
+	unsigned long hz;
+	int ret;
+
+	cc2530_ensure_debug(t);
+
+	cc2530_phase_start(t, &mark);
+	for (;;) {
+		hz = cc2530_clock();
+		ret = cc2530_chip_identify(t, info);
+		if (!ret)
+			break;
+
+		fprintf(stderr, "failed to identify chip\n");
+
+		/* slow down, then retry a few times at the slowest clock */
+		if (cc2530_clock_backoff(t, hz) && !--retry_cnt)
+			break;
+
+		trace_cmd(CMD_GET_CHIP, TRACE_RETRIED);
+		cc2530_enter_debug(t);
+	}
+	cc2530_phase_end(t, CC2530_PHASE_IDENTIFY, &mark);
+
+	if (ret)
+		fprintf(stderr, "timeout identifying the chip\n");
+
+	return ret;
+}
+
+/*
+ * Identify a target, then program or verify it with the image of the
+ * context
+ */
+static int cc2530_run_target(struct cc2530_target *t)
+{
+	struct cc2530_info info;
+	int ret;
+
+	ret = cc2530_target_identify(t, &info);
+	if (ret)
+		return ret;
+
+	memcpy(t->ext_addr, info.ext_addr, sizeof(t->ext_addr));
+
+	if (target_image_end(t) > info.flash_size) {
+		fprintf(stderr, "firmware file too big: %u (max: %u)\n",
+						target_image_end(t), info.flash_size);
+		return -1;
+	}
+
+	ret = t->ctx->run(t);
+	if (ret)
+		fprintf(stderr, "failed to %s chip\n",
+			t->ctx->run == cc2530_do_program ? "program" : "verify");
+
+	return ret;
+}
+
+static int cc2530_run_target_rt(struct cc2530_target *t)
+{
+	int ret;
+
+	if (!t->ctx->opts.realtime)
+		return cc2530_run_target(t);
+
+	rt_thread_enter(t->cpu);
+	ret = cc2530_run_target(t);
+	rt_thread_leave();
+
+	return ret;
+}
+
+static void *cc2530_target_thread(void *arg)
+{
+	struct cc2530_target *t = arg;
+
+	t->result = cc2530_run_target_rt(t);
+	cc2530_gang_leave(t);
+
+	return NULL;
+}
+
+/*
+ * Run the image through all the targets, each one from its own thread
+ * when there are several of them
+ */
+static int cc2530_run_targets(struct cc2530_ctx *ctx, const struct image *img,
+			      int (*run)(struct cc2530_target *t))
+{
+	struct cc2530_target *targets[CC2530_MAX_TARGETS];
+	bool started[CC2530_MAX_TARGETS] = { false };
+	int cpus[CC2530_MAX_TARGETS];
+	struct rt_process rt;
+	struct cc2530_target *t;
+	unsigned int i, n = 0;
+	int ret = 0;
+
+	for (i = 0; i < ctx->num_targets; i++) {
+		if (ctx->targets[i].enabled)
+			targets[n++] = &ctx->targets[i];
+	}
+
+	if (!n) {
+		fprintf(stderr, "no target to program\n");
+		return -1;
+	}
+
+	ctx->img = img;
+	ctx->run = run;
+
+	if (ctx->opts.realtime) {
+		for (i = 0; i < n; i++)
+			cpus[i] = targets[i]->cpu = rt_pick_cpu(ctx->opts.cpu, i);
+		rt_process_enter(&rt, cpus, n, ctx->opts.cpufreq);
+	}
+
+	if (n == 1) {
+		ret = targets[0]->result = cc2530_run_target_rt(targets[0]);
+		goto out;
+	}
+
+	/* burst write in lock-step if the backend can */
+	if (run == cc2530_do_program && !gpio_gang_shift_out(NULL, NULL, NULL, 0, 0)) {
+		ctx->gang.active = n;
+		ctx->gang.len = 2 + ctx->block_size;
+		for (i = 0; i < n; i++)
+			targets[i]->gang = &ctx->gang;
+	}
+
+	for (i = 0; i < n; i++) {
+		t = targets[i];
+		if (pthread_create(&t->thread, NULL, cc2530_target_thread, t)) {
+			fprintf(stderr, "failed to start target %d\n", t->index);
+			t->result = -1;
+			cc2530_gang_leave(t);
+			continue;
+		}
+		started[i] = true;
+	}
+
+	for (i = 0; i < n; i++) {
+		t = targets[i];
+		if (started[i])
+			pthread_join(t->thread, NULL);
+		if (t->result)
+			ret = -1;
+	}
+out:
+	if (ctx->opts.realtime)
+		rt_process_leave(&rt);
+	ctx->img = NULL;
+
+	return ret;
+}
+
+int cc2530_program(struct cc2530_ctx *ctx, const struct image *img)
+{
+	return cc2530_run_targets(ctx, img, cc2530_do_program);
+}
+
+int cc2530_verify(struct cc2530_ctx *ctx, const struct image *img)
+{
+	return cc2530_run_targets(ctx, img, cc2530_do_verify);
+}
+
+/*
+ * Compute the CRCs of all the flash pages of img, for -u and -C, and its
+ * CRC-32, for checkpoints, once for all the targets and runs
+ */
+int cc2530_prepare_image(struct cc2530_ctx *ctx, const struct image *img)
+{
+	unsigned int page;
+
+	ctx->prepared = NULL;
+	if (!img)
+		return 0;
+
+	if (!ctx->page_crcs) {
+		ctx->page_crcs = malloc(FLASH_MAX_PAGES * sizeof(*ctx->page_crcs));
+		if (!ctx->page_crcs) {
+			perror("malloc");
+			return -1;
+		}
+	}
+
+	for (page = 0; page < FLASH_MAX_PAGES; page++)
+		ctx->page_crcs[page] = page_crc(img, NULL, page * FLASH_PAGE_SIZE);
+	ctx->prepared_crc = image_crc32(img);
+	ctx->prepared = img;
+
+	return 0;
+}
+
+int cc2530_result(const struct cc2530_ctx *ctx, unsigned int target)
+{
+	if (target >= ctx->num_targets)
+		return -1;
+
+	return ctx->targets[target].result;
+}
+
+/*
+ * Single target operations
+ */
+static struct cc2530_target *cc2530_get_target(struct cc2530_ctx *ctx, unsigned int target)
+{
+	struct cc2530_target *t;
+
+	if (target >= ctx->num_targets) {
+		fprintf(stderr, "invalid target: %u (%u targets)\n", target, ctx->num_targets);
+		return NULL;
+	}
+
+	t = &ctx->targets[target];
+	cc2530_ensure_debug(t);
+
+	return t;
+}
+
+int cc2530_identify(struct cc2530_ctx *ctx, unsigned int target, struct cc2530_info *info)
+{
+	struct cc2530_target *t = cc2530_get_target(ctx, target);
+	struct cc2530_counters mark;
+	int ret;
+
+	if (!t)
+		return -1;
+
+	cc2530_phase_start(t, &mark);
+	ret = cc2530_chip_identify(t, info);
+	cc2530_phase_end(t, CC2530_PHASE_IDENTIFY, &mark);
+
+	return ret;
+}
+
+int cc2530_command(struct cc2530_ctx *ctx, unsigned int target, const char *name,
+		   uint8_t *result)
+{
+	struct cc2530_target *t;
+	const struct cc2530_cmd *cmd;
+
+	cmd = find_cmd_by_name(name);
+	if (!cmd) {
+		fprintf(stderr, "unknown command: %s\n", name);
+		return -1;
+	}
+
+	if (cmd->in) {
+		fprintf(stderr, "command %s takes parameters\n", cmd->name);
+		return -1;
+	}
+
+	t = cc2530_get_target(ctx, target);
+	if (!t)
+		return -1;
+
+	return cc2530_do_cmd(t, cmd, NULL, result);
+}
+
+int cc2530_read_xdata(struct cc2530_ctx *ctx, unsigned int target, uint16_t addr,
+		      uint8_t *buf, uint16_t len)
+{
+	struct cc2530_target *t = cc2530_get_target(ctx, target);
+
+	if (!t)
+		return -1;
+
+	return cc2530_read_xdata_memory_block(t, addr, buf, len);
+}
+
+int cc2530_write_xdata(struct cc2530_ctx *ctx, unsigned int target, uint16_t addr,
+		       const uint8_t *buf, uint16_t len)
+{
+	struct cc2530_target *t = cc2530_get_target(ctx, target);
+
+	if (!t)
+		return -1;
+
+	return cc2530_write_xdata_memory_block(t, addr, buf, len);
+}
+
+int cc2530_read_flash(struct cc2530_ctx *ctx, unsigned int target, uint32_t addr,
+		      uint8_t *buf, uint32_t len)
+{
+	struct cc2530_target *t = cc2530_get_target(ctx, target);
+
+	if (!t)
+		return -1;
+
+	return cc2530_flash_read(t, addr, buf, len);
+}
+
+int cc2530_reset(struct cc2530_ctx *ctx, unsigned int target)
+{
+	struct cc2530_target *t;
+
+	if (target >= ctx->num_targets) {
+		fprintf(stderr, "invalid target: %u (%u targets)\n", target, ctx->num_targets);
+		return -1;
+	}
+
+	t = &ctx->targets[target];
+	if (t->debug_enabled)
+		cc2530_leave_debug(t);
+
+	return 0;
+}
+
+/*
+ * Add a target wired to the given GPIOs, which must not be used by
+ * another target
+ */
+int cc2530_add_target(struct cc2530_ctx *ctx, int rst, int cclk, int data)
+{
+	struct cc2530_target *t;
+	unsigned int i;
+
+	if (ctx->num_targets == CC2530_MAX_TARGETS) {
+		fprintf(stderr, "too many targets (max: %d)\n", CC2530_MAX_TARGETS);
+		return -1;
+	}
+
+	for (i = 0; i < ctx->num_targets; i++) {
+		t = &ctx->targets[i];
+		if (t->rst == rst || t->rst == cclk || t->rst == data ||
+		    t->cclk == rst || t->cclk == cclk || t->cclk == data ||
+		    t->data == rst || t->data == cclk || t->data == data) {
+			fprintf(stderr, "target %d:%d:%d shares GPIOs with target %d\n",
+				rst, cclk, data, i);
+			return -1;
+		}
+	}
+
+	t = &ctx->targets[ctx->num_targets];
+	memset(t, 0, sizeof(*t));
+	t->ctx = ctx;
+	t->index = ctx->num_targets;
+	t->rst = rst;
+	t->rst_active_low = ctx->board->rst_active_low;
+	t->cclk = cclk;
+	t->data = data;
+	t->enabled = true;
+
+	if (cc2530_target_init(t)) {
+		fprintf(stderr, "failed to initialize GPIOs\n");
+		cc2530_target_deinit(t);
+		return -1;
+	}
+
+	ctx->num_targets++;
+
+	return 0;
+}
+
+unsigned int cc2530_num_targets(const struct cc2530_ctx *ctx)
+{
+	return ctx->num_targets;
+}
+
+int cc2530_enable_target(struct cc2530_ctx *ctx, unsigned int target, bool enable)
+{
+	if (target >= ctx->num_targets) {
+		fprintf(stderr, "invalid target: %u (%u targets)\n", target, ctx->num_targets);
+		return -1;
+	}
+
+	ctx->targets[target].enabled = enable;
+
+	return 0;
+}
+
+int cc2530_set_overlay(struct cc2530_ctx *ctx, unsigned int target,
+		       const struct image *overlay)
+{
+	if (target >= ctx->num_targets) {
+		fprintf(stderr, "invalid target: %u (%u targets)\n", target, ctx->num_targets);
+		return -1;
+	}
+
+	ctx->targets[target].overlay = overlay;
+
+	return 0;
+}
+
+const char *cc2530_phase_name(enum cc2530_phase phase)
+{
+	return phase < CC2530_NUM_PHASES ? phase_names[phase] : NULL;
+}
+
+uint64_t cc2530_phase_ns(const struct cc2530_ctx *ctx, unsigned int target,
+			 enum cc2530_phase phase)
+{
+	if (target >= ctx->num_targets || phase >= CC2530_NUM_PHASES)
+		return 0;
+
+	return ctx->targets[target].stats.phase[phase].ns;
+}
+
+struct cc2530_ctx *cc2530_open(const struct board *board, const struct cc2530_options *opts)
+{
+	struct cc2530_ctx *ctx;
+	unsigned int block_size;
+
+	block_size = opts->block_size ? opts->block_size : CC2530_DEFAULT_BLOCK_SIZE;
+	if (block_size < 4 || block_size > CC2530_MAX_BLOCK_SIZE ||
+	    (block_size & (block_size - 1))) {
+		fprintf(stderr, "invalid block size: %u (power of 2, 4 to %d)\n",
+				block_size, CC2530_MAX_BLOCK_SIZE);
+		return NULL;
+	}
+
+	if (opts->clock_hz && opts->clock_hz < CC2530_MIN_CLOCK_HZ) {
+		fprintf(stderr, "invalid debug clock: %lu (min: %d Hz)\n",
+				opts->clock_hz, CC2530_MIN_CLOCK_HZ);
+		return NULL;
+	}
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		perror("calloc");
+		return NULL;
+	}
+
+	ctx->board = board;
+	ctx->opts = *opts;
+	ctx->block_size = block_size;
+	pthread_mutex_init(&ctx->gang.lock, NULL);
+	pthread_cond_init(&ctx->gang.cond, NULL);
+
+	if (cc2530_gpio_init(ctx)) {
+		pthread_cond_destroy(&ctx->gang.cond);
+		pthread_mutex_destroy(&ctx->gang.lock);
+		free(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+void cc2530_set_options(struct cc2530_ctx *ctx, const struct cc2530_options *opts)
+{
+	ctx->opts = *opts;
+}
+
+/*
+ * Reset the targets still in debug mode and put back their GPIOs in a
+ * sane state
+ */
+void cc2530_close(struct cc2530_ctx *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->num_targets; i++) {
+		if (ctx->targets[i].debug_enabled)
+			cc2530_leave_debug(&ctx->targets[i]);
+		cc2530_target_deinit(&ctx->targets[i]);
+	}
+
+	cc2530_gpio_deinit();
+	pthread_cond_destroy(&ctx->gang.cond);
+	pthread_mutex_destroy(&ctx->gang.lock);
+	free(ctx->page_crcs);
+	free(ctx);
+}
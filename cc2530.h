@@ -0,0 +1,146 @@
+#ifndef __CC2530PROG_CC2530_H
+#define __CC2530PROG_CC2530_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "image.h"
+
+/*
+ * libcc2530: programming of CC2530 chips through their debug interface.
+ *
+ * A context drives one or more targets, each wired to its own RST, CCLK
+ * and DATA GPIOs. Calls on a context must not be made concurrently, but
+ * separate contexts can be used from separate threads. The GPIO backend
+ * and the debug clock are process-wide: all the contexts of a process
+ * must use the same board, and a clock back-off applies to all of them.
+ *
+ * Functions return 0 on success and a negative value on failure, after
+ * printing what went wrong on stderr.
+ */
+#define CC2530_MAX_TARGETS		16
+#define CC2530_DEFAULT_BLOCK_SIZE	1024
+#define CC2530_MAX_BLOCK_SIZE		2048
+#define CC2530_MIN_CLOCK_HZ		10000
+
+struct cc2530_ctx;
+
+struct cc2530_options {
+	/* messages on stdout, 2 adds per-block details */
+	unsigned int verbose;
+	/* verify after programming, using on-chip CRCs */
+	bool readback;
+	bool crc;
+	/* only erase and program the pages which changed */
+	bool update;
+	/*
+	 * Record the progress of a full programming in this file (suffixed
+	 * with the target number when there are several), so that the next
+	 * session for the same chip and image resumes from it. NULL disables.
+	 */
+	const char *checkpoint;
+	/* programming block size, 0 for CC2530_DEFAULT_BLOCK_SIZE */
+	unsigned int block_size;
+	/* debug clock limit, 0 is as fast as the backend goes */
+	unsigned long clock_hz;
+	/*
+	 * While programming or verifying, run each target from a SCHED_FIFO
+	 * thread pinned to its own CPU (the n-th allowed one from cpu, or from
+	 * the current CPU if negative) with the memory locked, and with the
+	 * performance cpufreq governor if cpufreq. Restored afterwards.
+	 */
+	bool realtime;
+	int cpu;
+	bool cpufreq;
+	/*
+	 * Called before each programmed block of a target, from the thread
+	 * programming it when there are several targets
+	 */
+	void (*progress)(void *arg, unsigned int target, uint32_t block,
+			 uint32_t num_blocks);
+	void *progress_arg;
+};
+
+/* programming phases, each target is timed in all of them */
+enum cc2530_phase {
+	CC2530_PHASE_ENTER_DEBUG,
+	CC2530_PHASE_IDENTIFY,
+	CC2530_PHASE_SETUP,
+	CC2530_PHASE_COMPARE,
+	CC2530_PHASE_ERASE,
+	CC2530_PHASE_PROGRAM,
+	CC2530_PHASE_VERIFY,
+	CC2530_NUM_PHASES,
+};
+
+struct cc2530_info {
+	uint8_t chip_id;
+	uint8_t revision;
+	uint8_t ext_addr[8];
+	bool usb;
+	uint32_t flash_size;
+};
+
+struct cc2530_ctx *cc2530_open(const struct board *board, const struct cc2530_options *opts);
+void cc2530_close(struct cc2530_ctx *ctx);
+/* block_size and clock_hz are only taken into account when opening */
+void cc2530_set_options(struct cc2530_ctx *ctx, const struct cc2530_options *opts);
+
+/* export the GPIOs of a target, targets are numbered in the order added */
+int cc2530_add_target(struct cc2530_ctx *ctx, int rst, int cclk, int data);
+unsigned int cc2530_num_targets(const struct cc2530_ctx *ctx);
+/* leave a target out of cc2530_program() and cc2530_verify(), or back in */
+int cc2530_enable_target(struct cc2530_ctx *ctx, unsigned int target, bool enable);
+/*
+ * Patch the image programmed into (or verified against) a target with
+ * the populated ranges of overlay, e.g. its IEEE address or calibration
+ * data, NULL for none. The overlay must stay loaded while in use.
+ */
+int cc2530_set_overlay(struct cc2530_ctx *ctx, unsigned int target,
+		       const struct image *overlay);
+
+/*
+ * Single target operations, the target is put in debug mode if needed
+ * and stays in it until it is reset
+ */
+int cc2530_identify(struct cc2530_ctx *ctx, unsigned int target, struct cc2530_info *info);
+/* send a debug command without parameters, its answer is up to 2 bytes */
+int cc2530_command(struct cc2530_ctx *ctx, unsigned int target, const char *name,
+		   uint8_t *result);
+int cc2530_read_xdata(struct cc2530_ctx *ctx, unsigned int target, uint16_t addr,
+		      uint8_t *buf, uint16_t len);
+int cc2530_write_xdata(struct cc2530_ctx *ctx, unsigned int target, uint16_t addr,
+		       const uint8_t *buf, uint16_t len);
+int cc2530_read_flash(struct cc2530_ctx *ctx, unsigned int target, uint32_t addr,
+		      uint8_t *buf, uint32_t len);
+/* leave debug mode, the chip runs its firmware */
+int cc2530_reset(struct cc2530_ctx *ctx, unsigned int target);
+
+/*
+ * Identify, program (or verify) all the targets then reset them, each
+ * target from its own thread when there are several. Fails if any of
+ * them failed, cc2530_result() tells which ones.
+ */
+int cc2530_program(struct cc2530_ctx *ctx, const struct image *img);
+int cc2530_verify(struct cc2530_ctx *ctx, const struct image *img);
+int cc2530_result(const struct cc2530_ctx *ctx, unsigned int target);
+/*
+ * Compute what only depends on img once, for the following runs with it
+ * (batch programming of a base image), until another image (or NULL) is
+ * prepared. img must stay loaded and unchanged meanwhile.
+ */
+int cc2530_prepare_image(struct cc2530_ctx *ctx, const struct image *img);
+
+void cc2530_print_info(const struct cc2530_info *info);
+void cc2530_show_command_list(void);
+const char *cc2530_phase_name(enum cc2530_phase phase);
+/* time spent by a target in a phase, since it was added */
+uint64_t cc2530_phase_ns(const struct cc2530_ctx *ctx, unsigned int target,
+			 enum cc2530_phase phase);
+/* per-phase timings and link statistics of all the targets, on stdout */
+void cc2530_bench_report(const struct cc2530_ctx *ctx, bool json, uint64_t gpio_init_ns);
+/* what led to a failure, when built with TRACE */
+void cc2530_trace_dump(void);
+
+#endif /* __CC2530PROG_CC2530_H */
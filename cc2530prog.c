@@ -10,1072 +10,845 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <getopt.h>
-#include <sys/stat.h>
 #include <unistd.h>
-#include <time.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <errno.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
-#include "gpio.h"
+#include "board.h"
+#include "cc2530.h"
+#include "image.h"
+#include "timing.h"
 
 #define ARRAY_SIZE(x)		(sizeof((x)) / sizeof((x[0])))
-#define DIV_ROUND_UP(n,d)	(((n) + (d) - 1) / (d))
 
-static unsigned int gpios[3] = { RST_GPIO, CCLK_GPIO, DATA_GPIO };
-
-struct cc2530_cmd {
-	char name[32];
-	uint8_t	id;
-	uint8_t in;
-	uint8_t out;
+enum bench_format {
+	BENCH_NONE,
+	BENCH_TEXT,
+	BENCH_JSON,
 };
 
-static unsigned debug_enabled;
-static unsigned verbose, progress;
-
-#define DEFAULT_TIMEOUT		1000
-
-#define CMD_ERASE		0x10
-#define CMD_WR_CFG		0x18
-#define CMD_RD_CFG		0x20
-#define CMD_GET_PC		0x28
-#define CMD_RD_ST		0x30
-#define CMD_SET_BRK		0x38
-#define CMD_HALT		0x40
-#define CMD_RESUME		0x48
-#define CMD_DBG_INST		0x50
-#define CMD_STEP_INST		0x58
-#define CMD_GET_BM		0x60
-#define CMD_GET_CHIP		0x68
-#define CMD_BURST_WR		0x80
-
-/* Various chip statuses */
-#define STACK_OVF		0x01
-#define OSC_STABLE		0x02
-#define DBG_LOCKED		0x04
-#define HALT_STATUS		0x08
-#define PWR_MODE_0		0x10
-#define CPU_HALTED		0x20
-#define PCON_IDLE		0x40
-#define CHIP_ERASE_BSY		0x80
-
-#define FCTL_BUSY		0x80
-
-/* IDs that we recognize */
-#define CC2530_ID		0xA5
-
-/* Buffers */
-#define ADDR_BUF0		0x0000 /* 1K */
-#define ADDR_BUF1		0x0400 /* 1K */
-#define ADDR_DMA_DESC		0x0800 /* 32 bytes */
-
-/* DMA Channels */
-#define CH_DBG_TO_BUF0	 	0x02
-#define CH_DBG_TO_BUF1	 	0x04
-#define CH_BUF0_TO_FLASH 	0x08
-#define CH_BUF1_TO_FLASH 	0x10
-
-#define PROG_BLOCK_SIZE		1024
-
-#define LOBYTE(w) ((uint8_t)(w))
-#define HIBYTE(w) ((uint8_t)(((uint16_t)(w) >> 8) & 0xFF))
+static enum bench_format do_bench;
+static struct cc2530_options opts;
+static struct cc2530_ctx *ctx;
 
-/*
- * Register offsets from ioCC2530.h
- * make sure that these are always extended registers (16-bits addr)
- * otherwise this simply will not work.
- */
-#define X_EXT_ADDR_BASE	0x616A
-#define DBGDATA		0x6260
-#define FCTL		0x6270
-#define FADDRL		0x6271
-#define FADDRH		0x6272
-#define FWDATA		0x6273
-#define X_CHIPINFO0	0x6276
-#define X_CHIPINFO1	0x6277
-
-#define X_MEMCTR	0x70C7
-#define X_DMA1CFGH	0x70D3
-#define X_DMA1CFGL	0x70D4
-#define X_DMAARM	0x70D6
-
-#define X_CLKCONCMD	0x70C6
-#define X_CLKCONSTA	0x709E
-
-const uint8_t dma_desc[32] = {
-	/* Debug Interface -> Buffer 0 (Channel 1) */
-	HIBYTE(DBGDATA),   		/* src[15:8] */
-	LOBYTE(DBGDATA),   		/* src[7:0] */
-	HIBYTE(ADDR_BUF0),              /* dest[15:8] */
-	LOBYTE(ADDR_BUF0),              /* dest[7:0] */
-	HIBYTE(PROG_BLOCK_SIZE),
-	LOBYTE(PROG_BLOCK_SIZE),
-	31,                             /* trigger DBG_BW */
-	0x11,                           /* increment destination */
-
-	/* Debug Interface -> Buffer 1 (Channel 2) */
-	HIBYTE(DBGDATA),   		/* src[15:8] */
-	LOBYTE(DBGDATA),   		/* src[7:0] */
-	HIBYTE(ADDR_BUF1),              /* dest[15:8] */
-	LOBYTE(ADDR_BUF1),              /* dest[7:0] */
-	HIBYTE(PROG_BLOCK_SIZE),
-	LOBYTE(PROG_BLOCK_SIZE),
-	31,                             /* trigger DBG_BW */
-	0x11,                           /* increment destination */
-
-	/* Buffer 0 -> Flash controller (Channel 3) */
-	HIBYTE(ADDR_BUF0),              /* src[15:8] */
-	LOBYTE(ADDR_BUF0),              /* src[7:0] */
-	HIBYTE(FWDATA),    		/* dest[15:8] */
-	LOBYTE(FWDATA),    		/* dest[7:0] */
-	HIBYTE(PROG_BLOCK_SIZE),
-	LOBYTE(PROG_BLOCK_SIZE),
-	18,                             /* trigger FLASH */
-	0x42,                           /* increment source */
-
-	/* Buffer 1 -> Flash controller (Channel 4) */
-	HIBYTE(ADDR_BUF1),              /* src[15:8] */
-	LOBYTE(ADDR_BUF1),              /* src[7:0] */
-	HIBYTE(FWDATA),    		/* dest[15:8] */
-	LOBYTE(FWDATA),    		/* dest[7:0] */
-	HIBYTE(PROG_BLOCK_SIZE),
-	LOBYTE(PROG_BLOCK_SIZE),
-	18,                             /* trigger FLASH */
-	0x42                            /* increment source */
-};
-
-static uint16_t flash_ptr = 0;
+/* rst, cclk and data GPIOs of each target */
+static int target_pins[CC2530_MAX_TARGETS][3];
 
-static void init_flash_ptr(void)
+/* progress of the first target only, the others go in lock-step */
+static void show_progress(void *arg, unsigned int target, uint32_t block,
+			  uint32_t num_blocks)
 {
-	flash_ptr = 0;
-}
+	(void)arg;
 
-static unsigned char *fwdata;
+	if (target)
+		return;
 
-static inline uint8_t get_next_flash_byte(void)
-{
-	return fwdata[flash_ptr++];
+	printf("%d/%d\n", block, num_blocks - 1);
+	fflush(stdout);
 }
 
-static inline void bytes_to_bits(uint8_t byte)
+static int identify_target(unsigned int target)
 {
-	int i;
+	struct cc2530_info info;
 
-	for (i = 0; i < 8; i++) {
-		if (byte & (1 << i))
-			printf("1");
-		else
-			printf("0");
-	}
-}
-
-static struct cc2530_cmd cc2530_commands[] = {
-	{
-		.name	= "erase",
-		.id	= CMD_ERASE,
-		.in	= 0,
-		.out	= 1,
-	}, {
-		.name	= "write_config",
-		.id	= CMD_WR_CFG,
-		.in	= 1,
-		.out	= 1,
-	}, {
-		.name	= "read_config",
-		.id	= CMD_RD_CFG,
-		.in	= 0,
-		.out	= 1,
-	}, {
-		.name	= "get_pc",
-		.id	= CMD_GET_PC,
-		.in	= 0,
-		.out	= 2,
-	}, {
-		.name	= "read_status",
-		.id	= CMD_RD_ST,
-		.in	= 0,
-		.out	= 1,
-	}, {
-		.name	= "halt",
-		.id	= CMD_HALT,
-		.in	= 0,
-		.out	= 1,
-	}, {
-		.name	= "resume",
-		.id	= CMD_RESUME,
-		.in	= 0,
-		.out	= 1,
-	}, {
-		.name	= "debug_inst",
-		.id	= CMD_DBG_INST,
-		.in	= -1,		/* variable */
-		.out	= 1,
-	}, {
-		.name	= "step_inst",
-		.id	= CMD_STEP_INST,
-		.in	= 0,
-		.out	= 1,
-	}, {
-		.name	= "get_bm",
-		.id	= CMD_GET_BM,
-		.in	= 0,
-		.out	= 1,
-	}, {
-		.name	= "get_chip_id",
-		.id	= CMD_GET_CHIP,
-		.in	= 0,
-		.out	= 2,
-	}, {
-		.name	= "burst_write",
-		.id	= CMD_BURST_WR,
-		.in	= -1,		/* variable */
-		.out	= 1,
-	},
-};
-
-static inline struct cc2530_cmd *find_cmd_by_name(const char *name)
-{
-	int len;
-	unsigned int i;
+	if (cc2530_identify(ctx, target, &info))
+		return -1;
 
-	for (i = 0; i < ARRAY_SIZE(cc2530_commands); i++) {
-		len = strlen(name);
-		if (!strncmp(cc2530_commands[i].name, name, len))
-			return &cc2530_commands[i];
-	}
+	/* the library only prints it when verbose */
+	if (!opts.verbose)
+		cc2530_print_info(&info);
 
-	return NULL;
+	return 0;
 }
 
-static void cc2530_show_command_list(void)
+static int oneshot_command(unsigned int target, const char *command)
 {
-	unsigned int i;
+	uint8_t result[2];
 
-	printf("Supported commands:\n");
-	for (i = 0; i < ARRAY_SIZE(cc2530_commands); i++)
-		printf("\t%s\n", cc2530_commands[i].name);
+	if (cc2530_command(ctx, target, command, result))
+		return -1;
+
+	printf("result: %02x\n", result[0]);
+
+	return 0;
 }
 
 /*
- * Perform GPIO initialization
+ * Program (or verify) all the targets, reporting each one when there
+ * are several
  */
-static int cc2530_gpio_init(void)
+static int program_targets(const struct image *img)
 {
-	int ret;
 	unsigned int i;
+	int ret;
 
-	for (i = 0; i < ARRAY_SIZE(gpios); i++) {
-		ret = gpio_export(gpios[i]);
-		if (ret) {
-			fprintf(stderr, "failed to export %d\n", gpios[i]);
-			return ret;
-		}
+	ret = cc2530_program(ctx, img);
 
-		ret = gpio_set_direction(gpios[i], GPIO_DIRECTION_OUT);
-		if (ret) {
-			fprintf(stderr, "failed to set direction on %d\n", gpios[i]);
-			return ret;
-		}
-	}
+	if (cc2530_num_targets(ctx) == 1 || do_bench == BENCH_JSON)
+		return ret;
 
-	return 0;
+	for (i = 0; i < cc2530_num_targets(ctx); i++)
+		printf("target %d (RST %d, CCLK %d, DATA %d): %s\n", i,
+			target_pins[i][0], target_pins[i][1], target_pins[i][2],
+			cc2530_result(ctx, i) ? "FAILED" : "OK");
+
+	return ret;
 }
 
 /*
- * Put back GPIOs in a sane state
+ * Daemon mode: the backend is initialized, the GPIOs exported and the
+ * targets entered in debug mode once, then requests are read from the
+ * clients of a Unix socket, one per line:
+ *
+ *	target <n>			select the target of the next requests
+ *	identify
+ *	command <name>			send a single debug command
+ *	read <addr> [len]		read XDATA memory
+ *	write <addr> <byte>...		write XDATA memory
+ *	program <file> [-r] [-C] [-u]	program all the targets
+ *	reset				leave debug mode, run the firmware
+ *	quit				close the connection
+ *	shutdown			stop the daemon
+ *
+ * A request prints what the equivalent cc2530prog invocation would,
+ * followed by a last "OK" or "FAILED" line. Clients are served one at a
+ * time, the target stays in debug mode between requests and clients.
  */
-static int cc2530_gpio_deinit(void)
-{
-	int ret;
-	unsigned int i;
+#define DAEMON_LINE_LEN		512
+#define DAEMON_MAX_ARGS		32
+#define DAEMON_MAX_READ		4096
 
-	for (i = 0; i < ARRAY_SIZE(gpios); i++) {
-		ret = gpio_set_direction(gpios[i], GPIO_DIRECTION_IN);
-		if (ret) {
-			fprintf(stderr, "failed to set direction on %d\n", gpios[i]);
-			return ret;
-		}
+static unsigned int daemon_target;
+static volatile sig_atomic_t daemon_stop;
+static int daemon_stdout = -1, daemon_stderr = -1;
 
-		ret = gpio_unexport(gpios[i]);
-		if (ret) {
-			fprintf(stderr, "failed to unexport %d\n", gpios[i]);
-			return ret;
-		}
+static int daemon_parse_addr(const char *arg, unsigned long max, unsigned long *value)
+{
+	char *end;
+
+	*value = strtoul(arg, &end, 0);
+	if (*end || *value > max) {
+		fprintf(stderr, "invalid value: %s (max: %#lx)\n", arg, max);
+		return -1;
 	}
 
 	return 0;
 }
 
-/*
- * Hold reset low while raising clock twice
- */
-static int cc2530_enter_debug(void)
+static int daemon_select(unsigned int target, int argc, char **argv)
 {
-	int i;
-
-	/* pulse RST low */
-	gpio_set_value(RST_GPIO, RST_GPIO_POL 0);
+	unsigned long n;
 
-	for (i = 0; i < 2; i++) {
-		gpio_set_value(CCLK_GPIO, 0);
-		gpio_set_value(CCLK_GPIO, 1);
-	}
+	(void)target;
+	(void)argc;
 
-	/* Keep clock low */
-	gpio_set_value(CCLK_GPIO, 0);
-
-	/* pulse Reset high */
-	gpio_set_value(RST_GPIO, RST_GPIO_POL 1);
+	if (daemon_parse_addr(argv[1], cc2530_num_targets(ctx) - 1, &n))
+		return -1;
 
-	debug_enabled = 1;
+	daemon_target = n;
 
 	return 0;
 }
 
-static int cc2530_leave_debug(void)
+static int daemon_identify(unsigned int target, int argc, char **argv)
 {
-	gpio_set_value(RST_GPIO, RST_GPIO_POL 0);
-	gpio_set_value(RST_GPIO, RST_GPIO_POL 1);
+	(void)argc;
+	(void)argv;
 
-	return 0;
+	return identify_target(target);
 }
 
-/*
- * Bit-bang a byte on the GPIO data line
- */
-static inline void send_byte(unsigned char byte)
+static int daemon_command(unsigned int target, int argc, char **argv)
 {
-	int i;
+	(void)argc;
 
-	/* Data setup on rising clock edge */
-	for (i = 7; i >= 0; i--) {
-		if (byte & (1 << i))
-			gpio_set_value(DATA_GPIO, 1);
-		else
-			gpio_set_value(DATA_GPIO, 0);
-		gpio_set_value(CCLK_GPIO, 1);
-		gpio_set_value(CCLK_GPIO, 0);
-	}
+	return oneshot_command(target, argv[1]);
 }
 
-/*
- * Clock in a byte from the GPIO line
- */
-static inline void read_byte(unsigned char *byte)
+static int daemon_read(unsigned int target, int argc, char **argv)
 {
-	int i;
-	bool val;
-	*byte = 0;
-
-	/* data read on falling clock edge */
-	for (i = 7; i >= 0; i--) {
-		gpio_set_value(CCLK_GPIO, 1);
-		gpio_get_value(DATA_GPIO, &val);
-		if (val)
-			*byte |= (1 << i);
-		gpio_set_value(CCLK_GPIO, 0);
+	unsigned char buf[DAEMON_MAX_READ];
+	unsigned long addr, len = 1, i;
+
+	if (daemon_parse_addr(argv[1], 0xffff, &addr))
+		return -1;
+	if (argc > 2 && daemon_parse_addr(argv[2], DAEMON_MAX_READ, &len))
+		return -1;
+	if (!len || addr + len > 0x10000) {
+		fprintf(stderr, "invalid XDATA range: %#lx+%lu\n", addr, len);
+		return -1;
 	}
+
+	if (cc2530_read_xdata(ctx, target, addr, buf, len))
+		return -1;
+
+	for (i = 0; i < len; i++)
+		printf("%s%02x", i % 16 ? " " : i ? "\n" : "", buf[i]);
+	printf("\n");
+
+	return 0;
 }
 
-/*
- * Send the command to the chip
- */
-static int cc2530_do_cmd(const struct cc2530_cmd *cmd, unsigned char *params, unsigned char *outbuf)
+static int daemon_write(unsigned int target, int argc, char **argv)
 {
-	int ret;
-	int bytes;
-	unsigned int timeout = DEFAULT_TIMEOUT;
-	bool val;
-	unsigned char *answer;
+	uint8_t values[DAEMON_MAX_ARGS];
+	unsigned long addr, value;
+	int i;
 
-	if (!cmd) {
-		fprintf(stderr, "invalid command\n");
+	if (daemon_parse_addr(argv[1], 0xffff, &addr))
 		return -1;
-	}
 
-	/* allocate as many bytes as we need to store the result */
-	answer = malloc(cmd->out);
-	if (!answer) {
-		perror("malloc");
-		return -1;
+	for (i = 2; i < argc; i++) {
+		if (daemon_parse_addr(argv[i], 0xff, &value))
+			return -1;
+		values[i - 2] = value;
 	}
-	memset(answer, 0, cmd->out);
 
-	ret = gpio_set_direction(DATA_GPIO, GPIO_DIRECTION_OUT);
-	if (ret) {
-		fprintf(stderr, "failed to put gpio in output direction\n");
-		goto out_exit;
+	if (addr + argc - 2 > 0x10000) {
+		fprintf(stderr, "invalid XDATA range: %#lx+%d\n", addr, argc - 2);
+		return -1;
 	}
 
-	/*
-	 * Debug instruction also needs to set the number of bytes
-	 * of the sent instruction.
-	 */
-	if (cmd->id == CMD_DBG_INST)
-		send_byte(cmd->id | cmd->in);
-	else
-		send_byte(cmd->id);
-
-	/* If there is any command payload also send it */
-	for (bytes = 0; bytes < cmd->in; bytes++)
-		send_byte(params[bytes]);
-
-	/* Now change the pin direction and wait for the chip to be ready
-	 * and sample the data pin until the chip is ready to answer */
-	ret = gpio_set_direction(DATA_GPIO, GPIO_DIRECTION_IN);
-	if (ret) {
-		fprintf(stderr, "failed to put back gpio in input direction\n");
-		goto out_exit;
-	}
+	return cc2530_write_xdata(ctx, target, addr, values, argc - 2);
+}
 
-	/*
-	 * Cope with commands requiring a response delay and those which do
-	 * not. In case the data line was not low right after we wrote data to
-	 * clock out the chip 8 times as per the specification mentions. The
-	 * data line should then be low and we are ready to read out from the
-	 * chip.
-	 */
-	gpio_get_value(DATA_GPIO, &val);
-	while (val && timeout--) {
-		for (bytes = 0; bytes < 8; bytes++) {
-			gpio_set_value(CCLK_GPIO, 1);
-			gpio_set_value(CCLK_GPIO, 0);
+static int daemon_program(unsigned int target, int argc, char **argv)
+{
+	struct cc2530_options req = opts;
+	struct image fw;
+	int i, ret = 0;
+
+	(void)target;
+
+	for (i = 2; i < argc && !ret; i++) {
+		if (!strcmp(argv[i], "-r"))
+			req.readback = true;
+		else if (!strcmp(argv[i], "-C"))
+			req.readback = req.crc = true;
+		else if (!strcmp(argv[i], "-u"))
+			req.update = true;
+		else {
+			fprintf(stderr, "unknown program option: %s\n", argv[i]);
+			ret = -1;
 		}
-		gpio_get_value(DATA_GPIO, &val);
 	}
 
-	if (!timeout) {
-		fprintf(stderr, "timed out waiting for chip to be ready again\n");
-		goto out_exit;
+	if (!ret && image_load(&fw, argv[1])) {
+		fprintf(stderr, "cannot load firmware: %s\n", argv[1]);
+		ret = -1;
 	}
 
-	/* Now read the answer */
-	for (bytes = 0; bytes < cmd->out; bytes++)
-		read_byte(&answer[bytes]);
+	if (!ret) {
+		if (opts.verbose)
+			printf("Using firmware file: %s (%u bytes)\n", argv[1], image_end(&fw));
+
+		cc2530_set_options(ctx, &req);
+		ret = program_targets(&fw);
+		cc2530_set_options(ctx, &opts);
+		image_free(&fw);
+	}
 
-	memcpy(outbuf, answer, cmd->out);
-out_exit:
-	free(answer);
 	return ret;
 }
 
-/*
- * Bypass the command sending infrastructure to allow
- * direct access to the what is sent to the chip
- */
-static int cc2530_burst_write(void)
+static int daemon_reset(unsigned int target, int argc, char **argv)
 {
-	int ret;
-	uint16_t i;
-	unsigned char result;
-	unsigned int timeout = DEFAULT_TIMEOUT;
-	bool val;
-
-	ret = gpio_set_direction(DATA_GPIO, GPIO_DIRECTION_OUT);
-	if (ret) {
-		fprintf(stderr, "failed to put gpio in output direction\n");
-		return ret;
-	}
+	(void)argc;
+	(void)argv;
 
-	send_byte(CMD_BURST_WR | HIBYTE(PROG_BLOCK_SIZE));
-	send_byte(LOBYTE(PROG_BLOCK_SIZE));
+	return cc2530_reset(ctx, target);
+}
 
-	for (i = 0; i < PROG_BLOCK_SIZE; i++)
-		send_byte(get_next_flash_byte());
+static const struct {
+	const char *name;
+	int min_args;
+	int max_args;
+	int (*run)(unsigned int target, int argc, char **argv);
+} daemon_requests[] = {
+	{ "target",	2, 2,			daemon_select },
+	{ "identify",	1, 1,			daemon_identify },
+	{ "command",	2, 2,			daemon_command },
+	{ "read",	2, 3,			daemon_read },
+	{ "write",	3, DAEMON_MAX_ARGS,	daemon_write },
+	{ "program",	2, 5,			daemon_program },
+	{ "reset",	1, 1,			daemon_reset },
+};
 
-	ret = gpio_set_direction(DATA_GPIO, GPIO_DIRECTION_IN);
-	if (ret) {
-		fprintf(stderr, "failed to put gpio in input direction\n");
-		return ret;
-	}
+static int daemon_request(int argc, char **argv)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(daemon_requests); i++) {
+		if (strcmp(argv[0], daemon_requests[i].name))
+			continue;
 
-	gpio_get_value(DATA_GPIO, &val);
-	while (val && timeout--) {
-		for (i = 0; i < 8; i++) {
-			gpio_set_value(CCLK_GPIO, 1);
-			gpio_set_value(CCLK_GPIO, 0);
+		if (argc < daemon_requests[i].min_args ||
+		    argc > daemon_requests[i].max_args) {
+			fprintf(stderr, "%s: wrong number of arguments\n", argv[0]);
+			return -1;
 		}
-		gpio_get_value(DATA_GPIO, &val);
-	}
 
-	if (!timeout) {
-		fprintf(stderr, "timed out waiting for chip to be ready\n");
-		return -1;
+		return daemon_requests[i].run(daemon_target, argc, argv);
 	}
 
-	read_byte(&result);
+	fprintf(stderr, "unknown request: %s\n", argv[0]);
 
-	return 0;
+	return -1;
 }
 
-static int cc2530_chip_erase(struct cc2530_cmd *cmd)
+/*
+ * Serve the requests of a client until it disconnects, the output of
+ * each request goes to the client. Returns true to stop the daemon.
+ */
+static bool daemon_client(int fd)
 {
-	int ret;
-	unsigned char result;
-	unsigned int timeout = DEFAULT_TIMEOUT;
-
-	cmd = find_cmd_by_name("erase");
-	ret = cc2530_do_cmd(cmd, NULL, &result);
-	if (ret) {
-		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-		return ret;
+	char line[DAEMON_LINE_LEN];
+	char *argv[DAEMON_MAX_ARGS];
+	char *saveptr;
+	bool stop = false;
+	FILE *f;
+	int argc, ret;
+
+	f = fdopen(fd, "r");
+	if (!f) {
+		perror("fdopen");
+		close(fd);
+		return false;
 	}
 
-	cmd = find_cmd_by_name("read_status");
-	do {
-		ret = cc2530_do_cmd(cmd, NULL, &result);
-		if (ret) {
-			fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-			return ret;
-		}
-		usleep(10);
-	} while ((result & CHIP_ERASE_BSY) && timeout--);
+	daemon_target = 0;
 
-	if (!timeout) {
-		fprintf(stderr, "timeout waiting for the chip to be erased\n");
-		return -1;
-	}
+	while (!daemon_stop && fgets(line, sizeof(line), f)) {
+		argc = 0;
+		argv[argc] = strtok_r(line, " \t\r\n", &saveptr);
+		while (argv[argc] && argc < DAEMON_MAX_ARGS - 1)
+			argv[++argc] = strtok_r(NULL, " \t\r\n", &saveptr);
+		if (!argc)
+			continue;
 
-	return 0;
-}
+		if (!strcmp(argv[0], "quit"))
+			break;
+		if (!strcmp(argv[0], "shutdown")) {
+			dprintf(fd, "OK\n");
+			stop = true;
+			break;
+		}
 
-static int cc2530_write_xdata_memory(struct cc2530_cmd *cmd, uint16_t addr, uint8_t value)
-{
-	int ret;
-	unsigned char instr[3];
-	unsigned char result;
-
-	cmd = find_cmd_by_name("debug_inst");
-	instr[0] = 0x90;
-	instr[1] = HIBYTE(addr);
-	instr[2] = LOBYTE(addr);
-	cmd->in = sizeof(instr);
-
-	ret = cc2530_do_cmd(cmd, instr, &result);
-	if (ret) {
-		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-		return ret;
-	}
+		fflush(stdout);
+		fflush(stderr);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
 
-	instr[0] = 0x74;
-	instr[1] = value;
-	cmd->in = 2;
+		ret = daemon_request(argc, argv);
+		if (ret)
+			cc2530_trace_dump();
+		printf("%s\n", ret ? "FAILED" : "OK");
 
-	ret = cc2530_do_cmd(cmd, instr, &result);
-	if (ret) {
-		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-		return ret;
+		fflush(stdout);
+		fflush(stderr);
+		dup2(daemon_stdout, STDOUT_FILENO);
+		dup2(daemon_stderr, STDERR_FILENO);
 	}
 
-	instr[0] = 0xF0;
-	cmd->in = 1;
-	ret = cc2530_do_cmd(cmd, instr, &result);
-	if (ret) {
-		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-		return ret;
-	}
+	fclose(f);
 
-	return 0;
+	return stop;
 }
 
-static int cc2530_read_xdata_memory(struct cc2530_cmd *cmd, uint16_t addr, unsigned char *result)
+static void daemon_signal(int sig)
 {
-	int ret;
-	unsigned char instr[3];
-	unsigned char res;
-
-	cmd = find_cmd_by_name("debug_inst");
-	instr[0] = 0x90;
-	instr[1] = HIBYTE(addr);
-	instr[2] = LOBYTE(addr);
-	cmd->in = sizeof(instr);
-
-	ret = cc2530_do_cmd(cmd, instr, result);
-	if (ret) {
-		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-		return ret;
-	}
-
-	instr[0] = 0xE0;
-	cmd->in = 1;
-
-	ret = cc2530_do_cmd(cmd, instr, &res);
-	if (ret) {
-		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-		return ret;
-	}
-	memcpy(result, &res, sizeof(res));
+	(void)sig;
 
-	return 0;
+	daemon_stop = 1;
 }
 
-static int cc2530_write_xdata_memory_block(struct cc2530_cmd *cmd,
-				uint16_t addr, const uint8_t *values, uint16_t num_bytes)
+/*
+ * Remove a stale socket left at the daemon path, a socket refusing
+ * connections: anything else there is reported and left alone
+ */
+static int daemon_remove_stale(const struct sockaddr_un *addr)
 {
-	int ret;
-	unsigned char instr[3];
-	unsigned char result;
-	uint16_t i;
-
-	cmd = find_cmd_by_name("debug_inst");
-	instr[0] = 0x90;
-	instr[1] = HIBYTE(addr);
-	instr[2] = LOBYTE(addr);
-	cmd->in = sizeof(instr);
-
-	ret = cc2530_do_cmd(cmd, instr, &result);
-	if (ret) {
-		fprintf(stderr, "failed to issue: %s\n", cmd->name);
-		return ret;
+	const char *path = addr->sun_path;
+	struct stat st;
+	int fd, ret;
+
+	if (lstat(path, &st)) {
+		if (errno == ENOENT)
+			return 0;
+		perror(path);
+		return -1;
 	}
 
-	for (i = 0; i < num_bytes; i++) {
-		instr[0] = 0x74;
-		instr[1] = values[i];
-		cmd->in = 2;
+	if (!S_ISSOCK(st.st_mode)) {
+		fprintf(stderr, "%s: exists and is not a socket\n", path);
+		return -1;
+	}
 
-		ret = cc2530_do_cmd(cmd, instr, &result);
-		if (ret) {
-			fprintf(stderr, "failed to issue: %s at %i\n", cmd->name, i);
-			return ret;
-		}
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
 
-		instr[0] = 0xF0;
-		cmd->in = 1;
-		ret = cc2530_do_cmd(cmd, instr, &result);
-		if (ret) {
-			fprintf(stderr, "failed to issue: %s at %i\n", cmd->name, i);
-			return ret;
-		}
+	ret = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) ? errno : 0;
+	close(fd);
 
-		instr[0] = 0xA3;
-		cmd->in = 1;
-		ret = cc2530_do_cmd(cmd, instr, &result);
-		if (ret) {
-			fprintf(stderr, "failed to issue: %s at %i\n", cmd->name, i);
-			return ret;
-		}
+	if (!ret) {
+		fprintf(stderr, "%s: another daemon is listening\n", path);
+		return -1;
+	}
+	if (ret != ECONNREFUSED) {
+		fprintf(stderr, "%s: %s\n", path, strerror(ret));
+		return -1;
+	}
+
+	if (unlink(path)) {
+		perror(path);
+		return -1;
 	}
 
 	return 0;
 }
 
-static uint32_t cc2530_flash_verify(struct cc2530_cmd *cmd, uint32_t max_addr)
+static int daemon_run(const char *path)
 {
-	uint8_t bank;
-	unsigned char instr[3];
-	unsigned char result;
-	unsigned char expected;
-	uint16_t i;
-	uint32_t addr = 0;
-	int ret;
-
-	for (bank = 0; bank < 8; bank++) {
-		if (verbose)
-			printf("Reading bank: %d\n", bank);
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	int sock, fd, ret = 0;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
 
-		ret = cc2530_write_xdata_memory(cmd, X_MEMCTR, bank);
-		if (ret) {
-			fprintf(stderr, "%s: failed to write to X_MEMCTR\n", __func__);
-			return ret;
-		}
+	/* a stale socket from a previous daemon */
+	if (daemon_remove_stale(&addr))
+		return -1;
 
-		cmd = find_cmd_by_name("debug_inst");
-		instr[0] = 0x90;
-		instr[1] = 0x80;
-		instr[2] = 0x00;
-		cmd->in = sizeof(instr);
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		perror("socket");
+		return -1;
+	}
 
-		ret = cc2530_do_cmd(cmd, instr, &result);
-		if (ret) {
-			fprintf(stderr, "%s: command failed: %s\n", __func__, cmd->name);
-			return ret;
-		}
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sock, 4)) {
+		perror(path);
+		close(sock);
+		return -1;
+	}
 
-		for (i = 0; i < 32*1024; i++) {
-			if (addr == max_addr)
-				return addr;
+	/* interrupt accept() on SIGINT/SIGTERM to clean up the targets */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = daemon_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
 
-			instr[0] = 0xE0;
-			cmd->in = 1;
-			ret = cc2530_do_cmd(cmd, instr, &result);
-			if (ret) {
-				fprintf(stderr, "%s: command failed at %i\n", __func__, i);
-				return ret;
-			}
+	daemon_stdout = dup(STDOUT_FILENO);
+	daemon_stderr = dup(STDERR_FILENO);
+	setvbuf(stdout, NULL, _IOLBF, 0);
 
-			expected = get_next_flash_byte();
-			if (result != expected) {
-				printf("[bank%d][%d], result: %02x, expected: %02x\n",
-						bank, i, result, expected);
-			}
+	if (opts.verbose)
+		printf("Listening on %s\n", path);
 
-			instr[0] = 0xA3;
-			cmd->in = 1;
-			ret = cc2530_do_cmd(cmd, instr, &result);
-			if (ret) {
-				fprintf(stderr, "%s: command failed at %i\n", __func__, i);
-				return ret;
-			}
-			addr++;
+	while (!daemon_stop) {
+		fd = accept(sock, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			ret = -1;
+			break;
 		}
+
+		if (daemon_client(fd))
+			break;
 	}
 
-	return addr;
+	close(daemon_stdout);
+	close(daemon_stderr);
+	close(sock);
+	unlink(path);
+
+	return ret;
 }
 
-static uint8_t cc2530_program_flash(struct cc2530_cmd *cmd, uint16_t num_buffers)
+static void usage(void)
 {
-	uint8_t dbg_arm, flash_arm;
-	uint8_t max_speed = 1;
-	uint16_t i;
-	uint8_t wait;
-	unsigned char result;
-	int ret;
-	unsigned int timeout = DEFAULT_TIMEOUT;
+	printf("Usage: cc2530prog [options]\n"
+		"\t-v:     verbose (twice for per-block details)\n"
+		"\t-i:     identify device\n"
+		"\t-P:     show progress\n"
+		"\t-f:     firmware file (raw binary, Intel HEX or ELF)\n"
+		"\t-r:     perform readback\n"
+		"\t-C:     verify using on-chip CRCs\n"
+		"\t-u:     only erase and program changed pages\n"
+		"\t-c:     single command to send\n"
+		"\t-l:     list available commands\n"
+		"\t-S:     programming block size (default: %d)\n"
+		"\t-g:     program a target wired to rst:cclk:data, repeat for gang programming\n"
+		"\t-b:     board wiring (default: %s)\n"
+		"\t--clock-hz <hz>: limit the debug clock (default: backend speed)\n"
+		"\t--bench[=text|json]: report per-phase timings and link statistics\n"
+		"\t--daemon <socket>: keep the targets in debug mode and serve requests\n"
+		"\t--realtime[=cpu]: program from SCHED_FIFO threads pinned from cpu\n"
+		"\t--cpufreq: with --realtime, use the performance cpufreq governor\n"
+		"\t--checkpoint <file>: record the programming progress, resume from it\n"
+		"\t--batch <manifest>: program a base image with per-device patches\n",
+		CC2530_DEFAULT_BLOCK_SIZE, board_default()->name);
+	exit(-1);
+}
 
-	/* Write the 4 DMA descriptors */
-	ret = cc2530_write_xdata_memory_block(cmd, ADDR_DMA_DESC, dma_desc, ARRAY_SIZE(dma_desc));
-	if (ret) {
-		fprintf(stderr, "%s: failed to write DMA descriptors\n", __func__);
-		return ret;
-	}
+/*
+ * Add a target wired to the given "rst:cclk:data" GPIOs
+ */
+static int add_target(const char *pins)
+{
+	unsigned int n = cc2530_num_targets(ctx);
+	int *p = target_pins[n];
 
-	/* Set the pointer to the DMA descriptors */
-	ret = cc2530_write_xdata_memory(cmd, X_DMA1CFGH, HIBYTE(ADDR_DMA_DESC));
-	if (ret) {
-		fprintf(stderr, "%s: failed to set DMA descriptors (part 1)\n", __func__);
-		return ret;
-	}
-	ret = cc2530_write_xdata_memory(cmd, X_DMA1CFGL, LOBYTE(ADDR_DMA_DESC));
-	if (ret) {
-		fprintf(stderr, "%s: failed to set DMA descriptors (part 2)\n", __func__);
-		return ret;
+	if (sscanf(pins, "%d:%d:%d", &p[0], &p[1], &p[2]) != 3) {
+		fprintf(stderr, "invalid target wiring: %s (rst:cclk:data)\n", pins);
+		return -1;
 	}
 
-	/* Make sure FADDR is 0x0000 */
-	ret = cc2530_write_xdata_memory(cmd, FADDRH, 0);
-	if (ret) {
-		fprintf(stderr, "%s: failed to set FADDRH\n", __func__);
-		return ret;
-	}
-	ret = cc2530_write_xdata_memory(cmd, FADDRL, 0);
-	if (ret) {
-		fprintf(stderr, "%s: failed to set FADDRL\n", __func__);
-		return ret;
-	}
+	return cc2530_add_target(ctx, p[0], p[1], p[2]);
+}
 
-	for (i = 0; i < num_buffers; i++) {
-		if (progress) {
-			printf("%d/%d\n", i, num_buffers - 1);
-			fflush(stdout);
-		}
-		/* Set what is to be written to DMAARM, based on loop iteration */
-		if ((i & 0x0001) == 0) {
-			dbg_arm = CH_DBG_TO_BUF0;
-			flash_arm = CH_BUF0_TO_FLASH;
-		} else {
-			dbg_arm = CH_DBG_TO_BUF1;
-			flash_arm = CH_BUF1_TO_FLASH;
-		}
+/*
+ * Batch mode: a manifest gives the base image, loaded and prepared once,
+ * and the devices to program with it, one per line ("#" comments):
+ *
+ *	image <file>
+ *	device <rst:cclk:data> [<addr>=<hex bytes>|<addr>=@<raw file>]...
+ *
+ * Each device patches the base image with its own data, typically its
+ * IEEE address or calibration data in the top page. Devices are taken
+ * in order by rounds of devices with distinct wirings, programmed
+ * together (in lock-step when the backend can); a device wired like one
+ * of the current round starts the next one, programmed back to back.
+ */
+#define BATCH_LINE_LEN		1024
+#define BATCH_FLASH_SIZE	(256 * 1024)
 
-		/* transfer next buffer (first buffer when i == 0) */
-		ret = cc2530_write_xdata_memory(cmd, X_DMAARM, dbg_arm);
-		if (ret) {
-			fprintf(stderr, "%s: failed to arm DMA\n", __func__);
-			return ret;
-		}
-		cc2530_burst_write();
-
-		/* wait for write to finish */
-		wait = 0;
-		do  {
-			ret = cc2530_read_xdata_memory(cmd, FCTL, &result);
-			if (ret) {
-				fprintf(stderr, "%s: failed at %i\n", __func__, i);
-				return ret;
-			}
-			wait = 1;
-		} while ((result & FCTL_BUSY) && timeout--);
+struct batch_device {
+	unsigned int line;
+	unsigned int target;
+	struct image overlay;
+};
 
-		if (!timeout) {
-			fprintf(stderr, "%s: timeout at %i\n", __func__, i);
-			return -1;
-		}
+static int batch_error(const char *path, unsigned int line, const char *msg, const char *arg)
+{
+	fprintf(stderr, "%s:%u: %s: %s\n", path, line, msg, arg);
+	return -1;
+}
 
-		/* no waiting means programming finished before burst write */
-		if (i > 0 && wait == 0)
-			max_speed = 0;
+/* the target wired to pins, added on first use */
+static int batch_target(const char *pins, unsigned int *target)
+{
+	unsigned int i, n = cc2530_num_targets(ctx);
+	int p[3];
 
-		/* start programming current buffer */
-		ret = cc2530_write_xdata_memory(cmd, X_DMAARM, flash_arm);
-		if (ret) {
-			fprintf(stderr, "%s: failed programming current buffer: %d\n", __func__, i);
-			return ret;
-		}
-		ret = cc2530_write_xdata_memory(cmd, FCTL, 0x06);
-		if (ret) {
-			fprintf(stderr, "%s: failed to set FCTL\n", __func__);
-			return ret;
-		}
+	if (sscanf(pins, "%d:%d:%d", &p[0], &p[1], &p[2]) != 3) {
+		fprintf(stderr, "invalid target wiring: %s (rst:cclk:data)\n", pins);
+		return -1;
 	}
 
-	timeout = DEFAULT_TIMEOUT;
-
-	/* Programming last buffer in progress, wait until done */
-	do {
-		ret = cc2530_read_xdata_memory(cmd, FCTL, &result);
-		if (ret) {
-			fprintf(stderr, "%s: failed\n", __func__);
-			return ret;
+	for (i = 0; i < n; i++) {
+		if (!memcmp(target_pins[i], p, sizeof(p))) {
+			*target = i;
+			return 0;
 		}
-	} while ((result & FCTL_BUSY) && timeout--);
-
-	if (!timeout) {
-		fprintf(stderr, "%s: timeout programming last buffer\n", __func__);
-		return -1;
 	}
 
-	return max_speed;
+	*target = n;
+	return add_target(pins);
 }
 
-static int cc2530_chip_identify(struct cc2530_cmd *cmd, int *flash_size)
+/* <addr>=<hex bytes> or <addr>=@<raw file> */
+static int batch_patch(struct image *overlay, const char *patch)
 {
-	int ret = 0;
-	unsigned char result[2] = { 0 };
-	unsigned char ext_addr[8] = { 0 };
-	int i;
-
-	ret = gpio_set_direction(DATA_GPIO, GPIO_DIRECTION_OUT);
-	if (ret) {
-		fprintf(stderr, "failed to set data gpio direction\n");
-		return ret;
-	}
+	uint8_t *data;
+	unsigned long addr;
+	const char *p;
+	char *end;
+	size_t len = 0;
+	unsigned int byte;
+	FILE *f;
+	int ret;
 
-	cmd = find_cmd_by_name("get_chip_id");
-	ret = cc2530_do_cmd(cmd, NULL, result);
-	if (ret) {
-		fprintf(stderr, "%s: failed to issue: %s\n", __func__, cmd->name);
-		goto out;
-	}
+	addr = strtoul(patch, &end, 0);
+	if (end == patch || *end != '=' || addr >= BATCH_FLASH_SIZE)
+		return -1;
+	p = end + 1;
 
-	/* Check that we actually know that chip */
-	if (result[0] != CC2530_ID) {
-		fprintf(stderr, "unknown Chip ID: %02x\n", result[0]);
-		if (result[0] == 0xFF || result[0] == 0)
-			fprintf(stderr, "someone is holding the CLK/DATA lines against us "
-					"make sure no debugger is *connected*\n");
-		ret = -EINVAL;
-		goto out;
+	data = malloc(BATCH_FLASH_SIZE);
+	if (!data) {
+		perror("malloc");
+		return -1;
 	}
 
-	if (verbose)
-		printf("Texas Instruments CC2530 (ID: 0x%02x, rev 0x%02x)\n", result[0], result[1]);
-	/*
-	 * Do some chip identification
-	 */
-	for (i = 0; i < 7; i++) {
-		ret = cc2530_read_xdata_memory(cmd, X_EXT_ADDR_BASE + i, result);
-		if (ret) {
-			fprintf(stderr, "%s: failed to read X_ETXADDR%d\n", __func__, i);
-			return ret;
+	if (*p == '@') {
+		f = fopen(p + 1, "rb");
+		if (!f) {
+			perror(p + 1);
+			free(data);
+			return -1;
 		}
-		ext_addr[i] = result[0];
-	}
-
-	if (verbose)
-		printf("Extended addr: %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x\n",
-			ext_addr[7], ext_addr[6], ext_addr[5], ext_addr[4],
-			ext_addr[3], ext_addr[2], ext_addr[1], ext_addr[0]);
-
-	ret = cc2530_read_xdata_memory(cmd, X_CHIPINFO0, result);
-	if (ret) {
-		fprintf(stderr, "failed to read X_CHIPINFO0 register\n");
-		return ret;
-	}
-
-	if (verbose) {
-		if (result[0] & 8)
-			printf("USB available\n");
-		else
-			printf("USB: not availabe\n");
-	}
-
-	switch ((result[0] & 0x70) >> 4) {
-	case 1:
-		*flash_size = 32;
-		break;
-	case 2:
-		*flash_size = 64;
-		break;
-	case 3:
-		*flash_size = 128;
-		break;
-	case 4:
-		*flash_size = 256;
+		len = fread(data, 1, BATCH_FLASH_SIZE - addr, f);
+		fclose(f);
+	} else {
+		/* bytes may be separated by colons, e.g. an IEEE address */
+		while (*p && len < BATCH_FLASH_SIZE - addr) {
+			if (*p == ':') {
+				p++;
+				continue;
+			}
+			if (sscanf(p, "%2x", &byte) != 1 || !p[1] || !isxdigit((unsigned char)p[1]))
+				break;
+			data[len++] = byte;
+			p += 2;
+		}
+		if (*p)
+			len = 0;
 	}
 
-	if (verbose)
-		printf("Flash size: %d KB\n", *flash_size);
+	ret = len ? image_add(overlay, addr, data, len) : -1;
+	free(data);
 
-	*flash_size *= 1024;
-
-	ret = cc2530_read_xdata_memory(cmd, X_CHIPINFO1, result);
-	if (ret) {
-		fprintf(stderr, "failed to read X_CHIPINFO1 register\n");
-		return ret;
-	}
-out:
 	return ret;
 }
 
-/*
- * Perform full CC2530 chip initialization and programming
- */
-static int cc2530_do_program(struct cc2530_cmd *cmd, off_t fwsize, unsigned do_readback)
+static int batch_load(const char *path, struct image *base, struct batch_device **devices,
+		      unsigned int *num_devices)
 {
+	char line[BATCH_LINE_LEN], *tok, *save;
+	struct batch_device *dev;
+	bool loaded = false;
+	unsigned int n = 0;
+	FILE *f;
 	int ret = 0;
-	unsigned char config;
-	unsigned char result;
-	uint32_t num_bytes_ok = 0;
-	uint16_t blocks;
-	unsigned int timeout = DEFAULT_TIMEOUT;
-	unsigned int retry_cnt = 3;
-
-	while (retry_cnt--) {
-		/* Enable DMA */
-		cmd = find_cmd_by_name("write_config");
-		config = 0x22;
-		ret = cc2530_do_cmd(cmd, &config, &result);
-		if (ret) {
-			fprintf(stderr, "failed to enable DMA\n");
-			return ret;
-		}
 
-		if (result != config) {
-			fprintf(stderr, "write config failed (retry count: %d)\n", retry_cnt);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
 
-			cc2530_enter_debug();
-			continue;
-		}
+	*devices = NULL;
+	while (!ret && fgets(line, sizeof(line), f)) {
+		n++;
+		line[strcspn(line, "#\r\n")] = '\0';
 
-		break;
-	}
+		tok = strtok_r(line, " \t", &save);
+		if (!tok)
+			continue;
 
-	ret = cc2530_write_xdata_memory(cmd, X_CLKCONCMD, 0x80);
-	if (ret) {
-		fprintf(stderr, "failed to write X_CLKCONCMD\n");
-		return ret;
-	}
+		if (!strcmp(tok, "image")) {
+			tok = strtok_r(NULL, " \t", &save);
+			if (!tok || loaded)
+				ret = batch_error(path, n, "invalid image", tok ? tok : "none");
+			else if (image_load(base, tok))
+				ret = batch_error(path, n, "cannot load firmware", tok);
+			else
+				loaded = true;
+			continue;
+		}
 
-	do {
-		ret = cc2530_read_xdata_memory(cmd, X_CLKCONSTA, &result);
-		if (ret) {
-			fprintf(stderr, "%s: failed to read X_CLKCONSTA\n", __func__);
-			return ret;
+		if (strcmp(tok, "device")) {
+			ret = batch_error(path, n, "unknown directive", tok);
+			continue;
 		}
-	} while ((result != 0x80) && timeout--);
 
-	if (!timeout) {
-		fprintf(stderr, "%s: timeout waiting for CLKCONSTA\n", __func__);
-		return -1;
-	}
+		dev = realloc(*devices, (*num_devices + 1) * sizeof(*dev));
+		if (!dev) {
+			perror("realloc");
+			ret = -1;
+			continue;
+		}
+		*devices = dev;
+		dev += *num_devices;
+		memset(dev, 0, sizeof(*dev));
+		dev->line = n;
+		(*num_devices)++;
+
+		tok = strtok_r(NULL, " \t", &save);
+		if (!tok || batch_target(tok, &dev->target)) {
+			ret = batch_error(path, n, "invalid device wiring", tok ? tok : "none");
+			continue;
+		}
 
-	ret = cc2530_chip_erase(cmd);
-	if (ret) {
-		fprintf(stderr, "failed to erase chip\n");
-		return ret;
+		while (!ret && (tok = strtok_r(NULL, " \t", &save))) {
+			if (batch_patch(&dev->overlay, tok))
+				ret = batch_error(path, n, "invalid patch", tok);
+		}
 	}
+	fclose(f);
 
-	init_flash_ptr();
-
-	blocks = DIV_ROUND_UP(fwsize, PROG_BLOCK_SIZE);
-
-	ret = cc2530_program_flash(cmd, blocks);
-	if (ret && verbose)
-		printf("Programmed at maximum speed\n");
+	if (!ret && !loaded)
+		ret = batch_error(path, n, "no image", "expected \"image <file>\"");
+	if (!ret && !*num_devices)
+		ret = batch_error(path, n, "no device", "expected \"device <rst:cclk:data>\"");
 
-	if (!do_readback)
-		goto cc2530_reset_mcu;
+	return ret;
+}
 
-	init_flash_ptr();
+static void batch_summary(unsigned int num_devices, unsigned int rounds, unsigned int failed,
+			  uint64_t elapsed_ns)
+{
+	uint64_t phase_ns[CC2530_NUM_PHASES] = { 0 }, total_ns = 0;
+	unsigned int i, p;
 
-	num_bytes_ok = cc2530_flash_verify(cmd, blocks * PROG_BLOCK_SIZE);
-	if (num_bytes_ok == (blocks * PROG_BLOCK_SIZE)) {
-		if (verbose)
-			printf("Verification OK\n");
-		goto cc2530_reset_mcu;
-	} else
-		if (verbose)
-			printf("Verification failed\n");
+	for (i = 0; i < cc2530_num_targets(ctx); i++) {
+		for (p = 0; p < CC2530_NUM_PHASES; p++)
+			phase_ns[p] += cc2530_phase_ns(ctx, i, p);
+	}
 
-cc2530_reset_mcu:
-	cc2530_leave_debug();
+	printf("Batch: %u devices in %u rounds, %u programmed, %u failed\n",
+		num_devices, rounds, num_devices - failed, failed);
+	printf("Elapsed: %.3f s, %.1f devices/hour\n", elapsed_ns / 1e9,
+		elapsed_ns ? (num_devices - failed) * 3600e9 / elapsed_ns : 0);
 
-	return 0;
+	printf("Average per device:\n");
+	for (p = 0; p < CC2530_NUM_PHASES; p++) {
+		total_ns += phase_ns[p];
+		if (phase_ns[p])
+			printf("\t%-12s %10.3f ms\n", cc2530_phase_name(p),
+				phase_ns[p] / 1e6 / num_devices);
+	}
+	printf("\t%-12s %10.3f ms\n", "total", total_ns / 1e6 / num_devices);
 }
 
-static int cc2530_oneshot_command(struct cc2530_cmd *cmd, const char *command)
+static int batch_run(const char *path)
 {
+	bool used[CC2530_MAX_TARGETS];
+	struct batch_device *devices = NULL;
+	unsigned int num_devices = 0, rounds = 0, failed = 0;
+	unsigned int first, next, i;
+	struct batch_device *dev;
+	struct image base;
+	uint64_t start_ns;
 	int ret;
-	unsigned char result;
 
-	cmd = find_cmd_by_name(command);
-	if (!cmd) {
-		fprintf(stderr, "unknown command: %s\n", command);
-		return -1;
-	}
+	memset(&base, 0, sizeof(base));
 
-	ret = cc2530_do_cmd(cmd, NULL, &result);
+	ret = batch_load(path, &base, &devices, &num_devices);
+	if (!ret)
+		ret = cc2530_prepare_image(ctx, &base);
 	if (ret)
-		return -1;
+		goto out;
 
-	printf("result: %02x\n", result);
+	if (opts.verbose)
+		printf("Batch %s: %u devices, base image of %u bytes\n", path,
+			num_devices, image_end(&base));
 
-	return 0;
-}
+	start_ns = timing_now_ns();
 
+	for (first = 0; first < num_devices; first = next) {
+		memset(used, 0, sizeof(used));
+		for (next = first; next < num_devices && !used[devices[next].target]; next++) {
+			used[devices[next].target] = true;
+			cc2530_set_overlay(ctx, devices[next].target, &devices[next].overlay);
+		}
 
-static void usage(void)
-{
-	printf("Usage: cc2530prog [options]\n"
-		"\t-v:     verbose\n"
-		"\t-i:     identify device\n"
-		"\t-P:     show progress\n"
-		"\t-f:     firmware file\n"
-		"\t-r:     perform readback\n"
-		"\t-c:     single command to send\n"
-		"\t-l:     list available commands\n");
-	exit(-1);
+		for (i = 0; i < cc2530_num_targets(ctx); i++)
+			cc2530_enable_target(ctx, i, used[i]);
+
+		cc2530_program(ctx, &base);
+		rounds++;
+
+		for (i = first; i < next; i++) {
+			dev = &devices[i];
+			if (cc2530_result(ctx, dev->target))
+				failed++;
+			if (do_bench != BENCH_JSON)
+				printf("device %u (line %u, RST %d, CCLK %d, DATA %d): %s\n", i,
+					dev->line, target_pins[dev->target][0],
+					target_pins[dev->target][1], target_pins[dev->target][2],
+					cc2530_result(ctx, dev->target) ? "FAILED" : "OK");
+		}
+	}
+
+	if (do_bench != BENCH_JSON)
+		batch_summary(num_devices, rounds, failed, timing_now_ns() - start_ns);
+	ret = failed ? -1 : 0;
+out:
+	cc2530_prepare_image(ctx, NULL);
+	for (i = 0; i < cc2530_num_targets(ctx); i++)
+		cc2530_set_overlay(ctx, i, NULL);
+	for (i = 0; i < num_devices; i++)
+		image_free(&devices[i].overlay);
+	free(devices);
+	image_free(&base);
+
+	return ret;
 }
 
+static const struct option long_options[] = {
+	{ "clock-hz",	required_argument,	NULL,	'k' },
+	{ "bench",	optional_argument,	NULL,	'B' },
+	{ "daemon",	required_argument,	NULL,	'D' },
+	{ "realtime",	optional_argument,	NULL,	'R' },
+	{ "cpufreq",	no_argument,		NULL,	'F' },
+	{ "checkpoint",	required_argument,	NULL,	'K' },
+	{ "batch",	required_argument,	NULL,	'M' },
+	{ NULL,		0,			NULL,	0 },
+};
+
 int main(int argc, char **argv)
 {
 	int opt, ret = 0;
 	const char *firmware = NULL;
-	unsigned do_readback = 0;
 	unsigned do_list = 0;
 	unsigned do_identify = 0;
 	char *command = NULL;
-	struct cc2530_cmd *cmd = NULL;
-	int f;
-	off_t fwsize;
-	struct stat buf;
-	int flash_size = 0;
-	unsigned int retry_cnt = 3;
-
-	while ((opt = getopt(argc, argv, "f:rlc:ivP")) > 0) {
+	const char *daemon_path = NULL;
+	const char *batch_path = NULL;
+	const char *gang_pins[CC2530_MAX_TARGETS];
+	unsigned int num_gang = 0;
+	const struct board *board;
+	struct image fw;
+	uint64_t gpio_init_ns = 0;
+	char pins[32];
+	unsigned int i;
+	char *end;
+
+	board = board_default();
+
+	while ((opt = getopt_long(argc, argv, "f:rCulc:ivPb:S:g:",
+				  long_options, NULL)) > 0) {
 		switch (opt) {
+		case 'b':
+			board = board_find(optarg);
+			if (!board) {
+				fprintf(stderr, "unknown board: %s\n", optarg);
+				board_show_list();
+				return -1;
+			}
+			break;
 		case 'f':
 			firmware = optarg;
 			break;
 		case 'r':
-			do_readback = 1;
+			opts.readback = true;
+			break;
+		case 'C':
+			opts.readback = true;
+			opts.crc = true;
+			break;
+		case 'u':
+			opts.update = true;
 			break;
 		case 'l':
 			do_list = 1;
@@ -1085,13 +858,65 @@ int main(int argc, char **argv)
 			break;
 		case 'i':
 			do_identify = 1;
-			verbose = 1;
+			if (!opts.verbose)
+				opts.verbose = 1;
 			break;
 		case 'v':
-			verbose = 1;
+			opts.verbose++;
 			break;
 		case 'P':
-			progress = 1;
+			opts.progress = show_progress;
+			break;
+		case 'S':
+			opts.block_size = strtoul(optarg, NULL, 0);
+			if (!opts.block_size) {
+				fprintf(stderr, "invalid block size: %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'k':
+			opts.clock_hz = strtoul(optarg, NULL, 0);
+			if (!opts.clock_hz) {
+				fprintf(stderr, "invalid debug clock: %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'B':
+			if (!optarg || !strcmp(optarg, "text"))
+				do_bench = BENCH_TEXT;
+			else if (!strcmp(optarg, "json"))
+				do_bench = BENCH_JSON;
+			else {
+				fprintf(stderr, "invalid benchmark format: %s (text or json)\n", optarg);
+				return -1;
+			}
+			break;
+		case 'D':
+			daemon_path = optarg;
+			break;
+		case 'R':
+			opts.realtime = true;
+			opts.cpu = optarg ? (int)strtoul(optarg, &end, 0) : -1;
+			if (optarg && (*end || end == optarg)) {
+				fprintf(stderr, "invalid CPU: %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'F':
+			opts.cpufreq = true;
+			break;
+		case 'K':
+			opts.checkpoint = optarg;
+			break;
+		case 'M':
+			batch_path = optarg;
+			break;
+		case 'g':
+			if (num_gang == CC2530_MAX_TARGETS) {
+				fprintf(stderr, "too many targets (max: %d)\n", CC2530_MAX_TARGETS);
+				return -1;
+			}
+			gang_pins[num_gang++] = optarg;
 			break;
 		default:
 			break;
@@ -1104,96 +929,85 @@ int main(int argc, char **argv)
 	if (argc < 2)
 		usage();
 
-	if (cc2530_gpio_init()) {
-		fprintf(stderr, "failed to initialize GPIOs\n");
+	if (opts.cpufreq && !opts.realtime) {
+		fprintf(stderr, "--cpufreq needs --realtime\n");
 		return -1;
 	}
 
-	if (!debug_enabled)
-		cc2530_enter_debug();
-
-	if (do_identify) {
-		ret = cc2530_chip_identify(cmd, &flash_size);
-		if (ret)
-			fprintf(stderr, "failed to identify chip\n");
-
-		goto out;
-	}
-
-	if (command) {
-		cc2530_oneshot_command(cmd, command);
-		goto out;
-	}
-
 	if (do_list) {
 		cc2530_show_command_list();
-		goto out;
+		board_show_list();
+		return 0;
 	}
 
-	if (stat(firmware, &buf) < 0) {
-		perror("stat");
-		goto out;
+	/* targets wired on the command line, or the single board target */
+	if (!num_gang && !batch_path) {
+		snprintf(pins, sizeof(pins), "%d:%d:%d", board->rst, board->cclk, board->data);
+		gang_pins[num_gang++] = pins;
 	}
 
-	if (!S_ISREG(buf.st_mode)) {
-		fprintf(stderr, "%s is not a regular file\n", firmware);
-		goto out;
-	}
+	gpio_init_ns = timing_now_ns();
 
-	fwsize = buf.st_size;
+	ctx = cc2530_open(board, &opts);
+	if (!ctx) {
+		fprintf(stderr, "failed to initialize GPIOs\n");
+		return -1;
+	}
 
-	while (retry_cnt--) {
-		ret = cc2530_chip_identify(cmd, &flash_size);
-		if (ret) {
-			fprintf(stderr, "failed to identify chip\n");
-			continue;
+	for (i = 0; i < num_gang; i++) {
+		if (add_target(gang_pins[i])) {
+			ret = -1;
+			goto out;
 		}
-
-		break;
 	}
 
-	if (!retry_cnt) {
-		fprintf(stderr, "timeout identifying the chip\n");
-		goto out;
-	}
+	gpio_init_ns = timing_now_ns() - gpio_init_ns;
 
-	if (fwsize > flash_size) {
-		fprintf(stderr, "firmware file too big: %ld (max: %d)\n",
-						fwsize, flash_size);
+	/* the targets are those of the manifest */
+	if (batch_path) {
+		ret = batch_run(batch_path);
 		goto out;
 	}
 
-	f = open(firmware, O_RDONLY);
-	if (!f) {
-		fprintf(stderr, "cannot open firmware: %s\n", firmware);
+	if (daemon_path) {
+		ret = daemon_run(daemon_path);
 		goto out;
 	}
 
-	if (verbose)
-		printf("Using firmware file: %s (%ld bytes)\n", firmware, fwsize);
+	if (do_identify || command) {
+		for (i = 0; i < num_gang; i++) {
+			if (num_gang > 1)
+				printf("target %d:\n", i);
 
-	fwdata = malloc(fwsize);
-	if (!fwdata) {
-		perror("malloc");
-		ret = -1;
-		goto out;
-	}
+			if (do_identify && identify_target(i)) {
+				fprintf(stderr, "failed to identify chip\n");
+				ret = -1;
+			}
 
-	if (read(f, fwdata, fwsize) < 0) {
-		fprintf(stderr, "premature end of read\n");
-		goto out_free;
+			if (command && oneshot_command(i, command))
+				ret = -1;
+		}
+		goto out;
 	}
 
-	if (cc2530_do_program(cmd, fwsize, do_readback)) {
-		fprintf(stderr, "failed to program chip\n");
+	if (image_load(&fw, firmware)) {
+		fprintf(stderr, "cannot load firmware: %s\n", firmware);
 		ret = -1;
+		goto out;
 	}
 
-out_free:
-	free(fwdata);
-	close(f);
+	if (opts.verbose)
+		printf("Using firmware file: %s (%u bytes)\n", firmware, image_end(&fw));
+
+	ret = program_targets(&fw);
+	image_free(&fw);
 out:
-	cc2530_leave_debug();
-	cc2530_gpio_deinit();
+	if (do_bench)
+		cc2530_bench_report(ctx, do_bench == BENCH_JSON, gpio_init_ns);
+
+	if (ret)
+		cc2530_trace_dump();
+
+	cc2530_close(ctx);
 	return ret;
 }
@@ -0,0 +1,299 @@
+/*
+ * gpio-bench - GPIO backend micro-benchmark
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "gpio.h"
+#include "timing.h"
+
+#define ARRAY_SIZE(x)		(sizeof((x)) / sizeof((x[0])))
+
+#define DEFAULT_ITERATIONS	100000
+#define SHIFT_LEN		2048
+
+/*
+ * Measures the raw cost of the GPIO operations of the selected backend
+ * (and transport) on the CCLK and DATA pins of a board, with no target
+ * attached: the pins are toggled as outputs and read back as inputs.
+ */
+static const struct board *board;
+static unsigned long iterations = DEFAULT_ITERATIONS;
+
+static uint8_t buf[SHIFT_LEN];
+
+static void report(const char *name, uint64_t ns, unsigned long ops, const char *unit)
+{
+	printf("%-24s %10.1f ns/op %14.0f %s\n", name, (double)ns / ops,
+		ops * 1e9 / ns, unit);
+}
+
+static int bench_set_value(void)
+{
+	uint64_t start;
+	unsigned long i;
+
+	start = timing_now_ns();
+	for (i = 0; i < iterations; i++) {
+		if (gpio_set_value(board->cclk, 1) ||
+		    gpio_set_value(board->cclk, 0))
+			return -1;
+	}
+	report("gpio_set_value", timing_now_ns() - start, 2 * iterations, "edges/s");
+
+	return 0;
+}
+
+static int bench_set_values(void)
+{
+	const int pins[2] = { board->data, board->cclk };
+	bool values[2] = { 0, 1 };
+	uint64_t start;
+	unsigned long i;
+
+	start = timing_now_ns();
+	for (i = 0; i < iterations; i++) {
+		values[0] = i & 1;
+		values[1] = 1;
+		if (gpio_set_values(pins, values, 2))
+			return -1;
+		values[1] = 0;
+		if (gpio_set_values(pins, values, 2))
+			return -1;
+	}
+	report("gpio_set_values", timing_now_ns() - start, 2 * iterations, "edges/s");
+
+	return 0;
+}
+
+static int bench_get_value(void)
+{
+	uint64_t start;
+	unsigned long i;
+	bool val;
+
+	if (gpio_set_direction(board->data, GPIO_DIRECTION_IN))
+		return -1;
+
+	start = timing_now_ns();
+	for (i = 0; i < iterations; i++) {
+		if (gpio_get_value(board->data, &val))
+			return -1;
+	}
+	report("gpio_get_value", timing_now_ns() - start, iterations, "reads/s");
+
+	return gpio_set_direction(board->data, GPIO_DIRECTION_OUT);
+}
+
+static int bench_direction(void)
+{
+	uint64_t start;
+	unsigned long i;
+
+	start = timing_now_ns();
+	for (i = 0; i < iterations; i++) {
+		if (gpio_set_direction(board->data, GPIO_DIRECTION_IN) ||
+		    gpio_set_direction(board->data, GPIO_DIRECTION_OUT))
+			return -1;
+	}
+	report("gpio_set_direction", timing_now_ns() - start, 2 * iterations, "switches/s");
+
+	return 0;
+}
+
+static int bench_clock_pulses(void)
+{
+	uint64_t start;
+	unsigned long i;
+
+	start = timing_now_ns();
+	for (i = 0; i < iterations / 8; i++) {
+		if (gpio_clock_pulses(board->cclk, 8))
+			return -1;
+	}
+	report("gpio_clock_pulses", timing_now_ns() - start, i * 8, "pulses/s");
+
+	return 0;
+}
+
+static int bench_shift_out(void)
+{
+	unsigned long i, n = iterations / SHIFT_LEN + 1;
+	uint64_t start;
+
+	start = timing_now_ns();
+	for (i = 0; i < n; i++) {
+		if (gpio_shift_out(board->cclk, board->data, buf, SHIFT_LEN))
+			return -1;
+	}
+	report("gpio_shift_out", timing_now_ns() - start, n * SHIFT_LEN * 8, "bits/s");
+
+	return 0;
+}
+
+static int bench_shift_in(void)
+{
+	unsigned long i, n = iterations / SHIFT_LEN + 1;
+	uint64_t start;
+
+	if (gpio_set_direction(board->data, GPIO_DIRECTION_IN))
+		return -1;
+
+	start = timing_now_ns();
+	for (i = 0; i < n; i++) {
+		if (gpio_shift_in(board->cclk, board->data, buf, SHIFT_LEN))
+			return -1;
+	}
+	report("gpio_shift_in", timing_now_ns() - start, n * SHIFT_LEN * 8, "bits/s");
+
+	return gpio_set_direction(board->data, GPIO_DIRECTION_OUT);
+}
+
+static int bench_gang_shift_out(void)
+{
+	const uint8_t *bufs[1] = { buf };
+	unsigned long i, n = iterations / SHIFT_LEN + 1;
+	uint64_t start;
+	int ret;
+
+	ret = gpio_gang_shift_out(NULL, NULL, NULL, 0, 0);
+	if (ret) {
+		printf("%-24s not supported\n", "gpio_gang_shift_out");
+		return 0;
+	}
+
+	start = timing_now_ns();
+	for (i = 0; i < n; i++) {
+		if (gpio_gang_shift_out(&board->cclk, &board->data, bufs, 1, SHIFT_LEN))
+			return -1;
+	}
+	report("gpio_gang_shift_out", timing_now_ns() - start, n * SHIFT_LEN * 8, "bits/s");
+
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	int (*run)(void);
+} benches[] = {
+	{ "set",	bench_set_value },
+	{ "set_values",	bench_set_values },
+	{ "get",	bench_get_value },
+	{ "direction",	bench_direction },
+	{ "pulses",	bench_clock_pulses },
+	{ "shift_out",	bench_shift_out },
+	{ "shift_in",	bench_shift_in },
+	{ "gang",	bench_gang_shift_out },
+};
+
+static void usage(void)
+{
+	unsigned int i;
+
+	printf("Usage: gpio-bench [options] [benchmark...]\n"
+		"\t-b:     board wiring (default: %s)\n"
+		"\t-n:     iterations (default: %d)\n"
+		"\t-k:     limit the clock to this frequency in Hz\n"
+		"Benchmarks:", board_default()->name, DEFAULT_ITERATIONS);
+	for (i = 0; i < ARRAY_SIZE(benches); i++)
+		printf(" %s", benches[i].name);
+	printf(" (default: all)\n");
+	exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long clock_hz = 0;
+	int opt, ret = 0, j;
+	unsigned int i;
+	int pins[2];
+
+	board = board_default();
+
+	while ((opt = getopt(argc, argv, "b:n:k:h")) > 0) {
+		switch (opt) {
+		case 'b':
+			board = board_find(optarg);
+			if (!board) {
+				fprintf(stderr, "unknown board: %s\n", optarg);
+				board_show_list();
+				return -1;
+			}
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			if (!iterations)
+				usage();
+			break;
+		case 'k':
+			clock_hz = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	for (i = 0; i < SHIFT_LEN; i++)
+		buf[i] = i * 0x5B;
+
+	if (gpio_init(board) || gpio_transport_init(board)) {
+		fprintf(stderr, "failed to initialize GPIOs\n");
+		return -1;
+	}
+
+	if (clock_hz && gpio_set_clock(clock_hz)) {
+		fprintf(stderr, "failed to set the clock to %lu Hz\n", clock_hz);
+		ret = -1;
+		goto out;
+	}
+
+	pins[0] = board->cclk;
+	pins[1] = board->data;
+	for (i = 0; i < ARRAY_SIZE(pins); i++) {
+		if (gpio_export(pins[i]) ||
+		    gpio_set_direction(pins[i], GPIO_DIRECTION_OUT)) {
+			fprintf(stderr, "failed to set up GPIO %d\n", pins[i]);
+			ret = -1;
+			goto out_unexport;
+		}
+	}
+
+	printf("board %s, CCLK %d, DATA %d, %lu iterations\n",
+		board->name, board->cclk, board->data, iterations);
+
+	for (i = 0; i < ARRAY_SIZE(benches); i++) {
+		if (optind < argc) {
+			for (j = optind; j < argc; j++) {
+				if (!strcmp(argv[j], benches[i].name))
+					break;
+			}
+			if (j == argc)
+				continue;
+		}
+
+		if (benches[i].run()) {
+			fprintf(stderr, "%s: failed\n", benches[i].name);
+			ret = -1;
+		}
+	}
+
+out_unexport:
+	for (i = 0; i < ARRAY_SIZE(pins); i++) {
+		gpio_set_direction(pins[i], GPIO_DIRECTION_IN);
+		gpio_unexport(pins[i]);
+	}
+out:
+	gpio_transport_exit();
+	gpio_exit();
+	return ret;
+}
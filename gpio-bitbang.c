@@ -0,0 +1,194 @@
+/*
+ * Generic bit-banged bulk GPIO operations
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <errno.h>
+
+#include "gpio.h"
+#include "timing.h"
+#include "trace.h"
+
+/*
+ * These are built on top of the mandatory single pin operations and
+ * are only used when the selected GPIO backend does not provide its
+ * own implementation.
+ */
+__weak int gpio_set_values(const int *n, const bool *value, unsigned int count)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < count; i++) {
+		ret = gpio_set_value(n[i], value[i]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+__weak int gpio_shift_out(int cclk, int data, const uint8_t *buf, size_t len)
+{
+	const int pins[2] = { data, cclk };
+	bool values[2] = { 0, 1 };
+	size_t i;
+	int bit;
+
+	/*
+	 * Data setup on rising clock edge, the target samples it on the
+	 * falling edge so DATA and CCLK can be changed in one operation.
+	 */
+	for (i = 0; i < len; i++) {
+		for (bit = 7; bit >= 0; bit--) {
+			values[0] = !!(buf[i] & (1 << bit));
+			if (gpio_set_values(pins, values, 2))
+				return -1;
+			timing_edge();
+			if (gpio_set_value(cclk, 0))
+				return -1;
+			timing_edge();
+		}
+	}
+
+	return 0;
+}
+
+__weak int gpio_shift_in(int cclk, int data, uint8_t *buf, size_t len)
+{
+	size_t i;
+	int bit;
+	bool val;
+
+	/* data read on falling clock edge */
+	for (i = 0; i < len; i++) {
+		buf[i] = 0;
+		for (bit = 7; bit >= 0; bit--) {
+			if (gpio_set_value(cclk, 1))
+				return -1;
+			timing_edge();
+			if (gpio_get_value(data, &val))
+				return -1;
+			if (val)
+				buf[i] |= (1 << bit);
+			if (gpio_set_value(cclk, 0))
+				return -1;
+			timing_edge();
+		}
+	}
+
+	return 0;
+}
+
+__weak int gpio_clock_pulses(int cclk, unsigned int n)
+{
+	while (n--) {
+		if (gpio_set_value(cclk, 1))
+			return -1;
+		timing_edge();
+		if (gpio_set_value(cclk, 0))
+			return -1;
+		timing_edge();
+	}
+
+	return 0;
+}
+
+__weak int gpio_transaction(int cclk, int data, const uint8_t *out, size_t out_len,
+			    uint8_t *in, size_t in_len, unsigned int timeout_ms)
+{
+	struct timing_deadline d;
+	unsigned int polls = 0;
+	bool val;
+
+	if (gpio_set_direction(data, GPIO_DIRECTION_OUT))
+		return -1;
+
+	if (gpio_shift_out(cclk, data, out, out_len))
+		return -1;
+
+	/* Now change the pin direction and wait for the chip to be ready
+	 * and sample the data pin until the chip is ready to answer */
+	if (gpio_set_direction(data, GPIO_DIRECTION_IN))
+		return -1;
+
+	/*
+	 * Cope with commands requiring a response delay and those which do
+	 * not. In case the data line was not low right after we wrote data to
+	 * clock out the chip 8 times as per the specification mentions. The
+	 * data line should then be low and we are ready to read out from the
+	 * chip.
+	 */
+	if (gpio_get_value(data, &val))
+		return -1;
+
+	if (val)
+		timing_wait_start(&d, 0, timeout_ms);
+
+	while (val) {
+		if (timing_wait_poll(&d)) {
+			trace_ready(polls);
+			return -ETIMEDOUT;
+		}
+
+		if (gpio_clock_pulses(cclk, 8))
+			return -1;
+		if (gpio_get_value(data, &val))
+			return -1;
+		polls++;
+	}
+
+	trace_ready(polls);
+
+	/* Now read the answer */
+	return gpio_shift_in(cclk, data, in, in_len);
+}
+
+__weak int gpio_transactions(int cclk, int data, const struct gpio_xfer *xfer,
+			     unsigned int count, unsigned int timeout_ms)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < count; i++) {
+		ret = gpio_transaction(cclk, data, xfer[i].out, xfer[i].out_len,
+				       xfer[i].in, xfer[i].in_len, timeout_ms);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+__weak int gpio_gang_shift_out(const int *cclk, const int *data, const uint8_t *const *buf,
+			       unsigned int count, size_t len)
+{
+	(void)cclk;
+	(void)data;
+	(void)buf;
+	(void)count;
+	(void)len;
+
+	return -ENOSYS;
+}
+
+__weak int gpio_set_clock(unsigned long hz)
+{
+	return timing_set_clock(hz);
+}
+
+/* no alternate transport, everything goes through the GPIO backend */
+__weak int gpio_transport_init(const struct board *board)
+{
+	(void)board;
+
+	return 0;
+}
+
+__weak void gpio_transport_exit(void)
+{
+}
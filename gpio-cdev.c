@@ -0,0 +1,331 @@
+/*
+ * Linux GPIO backend using the GPIO character device (GPIO_V2 ABI)
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "gpio.h"
+
+#ifndef GPIO_CDEV_CHIP
+#define GPIO_CDEV_CHIP	"/dev/gpiochip0"
+#endif
+
+#define GPIO_CDEV_CONSUMER	"cc2530prog"
+
+/*
+ * All exported GPIOs are lines of the same chip and are requested
+ * together as a single line request, bit i of the request masks is
+ * the line stored at lines[i].
+ */
+static const char *chip_path = GPIO_CDEV_CHIP;
+static int chip_fd = -1;
+static int req_fd = -1;
+static unsigned int lines[GPIO_V2_LINES_MAX];
+static unsigned int num_lines;
+
+/* bitmap of the lines configured as output and their cached values */
+static uint64_t output_mask;
+static uint64_t output_values;
+
+/*
+ * The cached values are shared by all the lines of the request, which
+ * is requested again each time a line is added or removed: the lock
+ * covers the line indices and req_fd as well
+ */
+static pthread_mutex_t lines_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int find_line(int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_lines; i++) {
+		if (lines[i] == (unsigned int)n)
+			return i;
+	}
+
+	return -1;
+}
+
+static int line_index(int n)
+{
+	int i;
+
+	i = find_line(n);
+	if (i < 0)
+		fprintf(stderr, "GPIO %d is not exported\n", n);
+
+	return i;
+}
+
+/*
+ * Build a line configuration describing the current direction and
+ * output value of every requested line. The kernel applies the value
+ * of every output line on each reconfiguration, so the cached values
+ * must always be passed along to avoid glitching RST or CCLK.
+ */
+static void fill_line_config(struct gpio_v2_line_config *config)
+{
+	uint64_t all = (num_lines == 64) ? ~0ULL : (1ULL << num_lines) - 1;
+	struct gpio_v2_line_config_attribute *attr;
+
+	memset(config, 0, sizeof(*config));
+	config->flags = GPIO_V2_LINE_FLAG_INPUT;
+
+	if (output_mask) {
+		attr = &config->attrs[config->num_attrs++];
+		attr->attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+		attr->attr.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		attr->mask = output_mask & all;
+
+		attr = &config->attrs[config->num_attrs++];
+		attr->attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		attr->attr.values = output_values;
+		attr->mask = output_mask & all;
+	}
+}
+
+static int request_lines(void)
+{
+	struct gpio_v2_line_request req;
+	unsigned int i;
+
+	if (req_fd >= 0) {
+		close(req_fd);
+		req_fd = -1;
+	}
+
+	if (!num_lines)
+		return 0;
+
+	memset(&req, 0, sizeof(req));
+	for (i = 0; i < num_lines; i++)
+		req.offsets[i] = lines[i];
+	req.num_lines = num_lines;
+	strncpy(req.consumer, GPIO_CDEV_CONSUMER, sizeof(req.consumer) - 1);
+	fill_line_config(&req.config);
+
+	if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+		perror("GPIO_V2_GET_LINE_IOCTL");
+		return -1;
+	}
+
+	req_fd = req.fd;
+
+	return 0;
+}
+
+int gpio_init(const struct board *board)
+{
+	if (board->chip)
+		chip_path = board->chip;
+
+	return 0;
+}
+
+void gpio_exit(void)
+{
+	if (req_fd >= 0)
+		close(req_fd);
+	if (chip_fd >= 0)
+		close(chip_fd);
+
+	req_fd = chip_fd = -1;
+	num_lines = 0;
+	output_mask = output_values = 0;
+}
+
+int gpio_export(int n)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&lines_lock);
+
+	if (chip_fd < 0) {
+		chip_fd = open(chip_path, O_RDWR | O_CLOEXEC);
+		if (chip_fd < 0) {
+			perror(chip_path);
+			ret = -1;
+			goto out;
+		}
+	}
+
+	if (find_line(n) >= 0)
+		goto out;
+
+	if (num_lines == GPIO_V2_LINES_MAX) {
+		fprintf(stderr, "too many exported GPIOs\n");
+		ret = -1;
+		goto out;
+	}
+
+	lines[num_lines++] = n;
+
+	/* the line set of a request is fixed, so request them all again */
+	ret = request_lines();
+out:
+	pthread_mutex_unlock(&lines_lock);
+	return ret;
+}
+
+int gpio_unexport(int n)
+{
+	uint64_t low, high;
+	int ret = 0;
+	int i;
+
+	pthread_mutex_lock(&lines_lock);
+
+	i = line_index(n);
+	if (i < 0) {
+		ret = -1;
+		goto out;
+	}
+
+	/* drop bit i from the bitmaps, moving the upper lines down */
+	low = (1ULL << i) - 1;
+	high = ~low << 1;
+	output_mask = (output_mask & low) | ((output_mask & high) >> 1);
+	output_values = (output_values & low) | ((output_values & high) >> 1);
+
+	num_lines--;
+	memmove(&lines[i], &lines[i + 1], (num_lines - i) * sizeof(lines[0]));
+
+	if (request_lines()) {
+		ret = -1;
+		goto out;
+	}
+
+	if (!num_lines) {
+		close(chip_fd);
+		chip_fd = -1;
+	}
+out:
+	pthread_mutex_unlock(&lines_lock);
+	return ret;
+}
+
+int gpio_set_direction(int n, enum gpio_direction direction)
+{
+	struct gpio_v2_line_config config;
+	uint64_t bit;
+	int i;
+
+	pthread_mutex_lock(&lines_lock);
+
+	i = line_index(n);
+	if (i < 0) {
+		pthread_mutex_unlock(&lines_lock);
+		return -1;
+	}
+
+	bit = 1ULL << i;
+
+	switch (direction) {
+	case GPIO_DIRECTION_IN:
+		output_mask &= ~bit;
+		break;
+	case GPIO_DIRECTION_OUT:
+		output_mask |= bit;
+		output_values &= ~bit;
+		break;
+	case GPIO_DIRECTION_HIGH:
+		output_mask |= bit;
+		output_values |= bit;
+		break;
+	}
+
+	fill_line_config(&config);
+
+	if (ioctl(req_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+		perror("GPIO_V2_LINE_SET_CONFIG_IOCTL");
+		pthread_mutex_unlock(&lines_lock);
+		return -1;
+	}
+
+	pthread_mutex_unlock(&lines_lock);
+
+	return 0;
+}
+
+int gpio_get_value(int n, bool *value)
+{
+	struct gpio_v2_line_values values;
+	int i;
+
+	pthread_mutex_lock(&lines_lock);
+
+	i = line_index(n);
+	if (i < 0) {
+		pthread_mutex_unlock(&lines_lock);
+		return -1;
+	}
+
+	values.bits = 0;
+	values.mask = 1ULL << i;
+
+	if (ioctl(req_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+		perror("GPIO_V2_LINE_GET_VALUES_IOCTL");
+		pthread_mutex_unlock(&lines_lock);
+		return -1;
+	}
+
+	pthread_mutex_unlock(&lines_lock);
+
+	*value = !!(values.bits & values.mask);
+
+	return 0;
+}
+
+int gpio_set_value(int n, bool value)
+{
+	return gpio_set_values(&n, &value, 1);
+}
+
+int gpio_set_values(const int *n, const bool *value, unsigned int count)
+{
+	struct gpio_v2_line_values values;
+	unsigned int j;
+	int i;
+
+	values.bits = 0;
+	values.mask = 0;
+
+	pthread_mutex_lock(&lines_lock);
+
+	for (j = 0; j < count; j++) {
+		i = line_index(n[j]);
+		if (i < 0) {
+			pthread_mutex_unlock(&lines_lock);
+			return -1;
+		}
+
+		values.mask |= 1ULL << i;
+		if (value[j])
+			values.bits |= 1ULL << i;
+	}
+
+	if (ioctl(req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+		perror("GPIO_V2_LINE_SET_VALUES_IOCTL");
+		pthread_mutex_unlock(&lines_lock);
+		return -1;
+	}
+
+	output_values = (output_values & ~values.mask) | values.bits;
+
+	pthread_mutex_unlock(&lines_lock);
+
+	return 0;
+}
@@ -0,0 +1,618 @@
+/*
+ * FTDI MPSSE (FT2232H/FT232H) backend using libftdi1
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <ftdi.h>
+
+#include "gpio.h"
+#include "timing.h"
+#include "trace.h"
+
+#ifndef FTDI_CLOCK_HZ
+#define FTDI_CLOCK_HZ		1000000
+#endif
+
+/* MPSSE base clock with the divide by 5 disabled */
+#define FTDI_BASE_HZ		60000000
+
+#define FTDI_READ_TIMEOUT_MS	1000
+
+/* longest answer sampled for readiness before each byte */
+#define FTDI_MAX_ANSWER		16
+
+#define DIV_ROUND_UP(n,d)	(((n) + (d) - 1) / (d))
+
+/*
+ * The CC2530 debug port uses the MPSSE serial engine pins: CCLK is on
+ * ADBUS0 (TCK/SK), DATA is driven from ADBUS1 (TDI/DO) and read back
+ * on ADBUS2 (TDO/DI), both tied to the DATA line. The remaining ADBUS
+ * pins can be used as GPIOs, e.g. for RST.
+ */
+#define FTDI_CCLK		0
+#define FTDI_DATA		1
+#define FTDI_DI_BIT		(1 << 2)
+#define FTDI_SERIAL_PINS	((1 << FTDI_CCLK) | (1 << FTDI_DATA) | FTDI_DI_BIT)
+
+/* MPSSE commands */
+#define MPSSE_WRITE_BYTES_PVE	0x10	/* MSB first, out on rising edge */
+#define MPSSE_READ_BYTES_NVE	0x24	/* MSB first, in on falling edge */
+#define MPSSE_SET_BITS_LOW	0x80
+#define MPSSE_GET_BITS_LOW	0x81
+#define MPSSE_LOOPBACK_OFF	0x85
+#define MPSSE_SET_DIVISOR	0x86
+#define MPSSE_SEND_IMMEDIATE	0x87
+#define MPSSE_DIS_DIV_5		0x8A
+#define MPSSE_DIS_3_PHASE	0x8D
+#define MPSSE_CLK_BITS		0x8E
+#define MPSSE_CLK_BYTES		0x8F
+#define MPSSE_DIS_ADAPTIVE	0x97
+
+static struct ftdi_context *ftdi;
+
+/* commands are queued here and sent as a single USB bulk write */
+static uint8_t queue[4096];
+static size_t queue_len;
+
+/* cached ADBUS output values and directions */
+static uint8_t pins_value;
+static uint8_t pins_dir;
+
+/*
+ * Exported ADBUS pins: the queue above and the serial engine pins serve
+ * a single target, with its RST on one of the remaining pins
+ */
+static uint8_t pins_exported;
+
+static int ftdi_flush(void)
+{
+	int ret;
+
+	if (!queue_len)
+		return 0;
+
+	ret = ftdi_write_data(ftdi, queue, queue_len);
+	if (ret != (int)queue_len) {
+		fprintf(stderr, "ftdi: write failed: %s\n", ftdi_get_error_string(ftdi));
+		queue_len = 0;
+		return -1;
+	}
+
+	queue_len = 0;
+
+	return 0;
+}
+
+static int ftdi_queue(const uint8_t *cmd, size_t len)
+{
+	if (queue_len + len > sizeof(queue) && ftdi_flush())
+		return -1;
+
+	if (len > sizeof(queue)) {
+		if (ftdi_write_data(ftdi, (unsigned char *)cmd, len) != (int)len) {
+			fprintf(stderr, "ftdi: write failed: %s\n", ftdi_get_error_string(ftdi));
+			return -1;
+		}
+		return 0;
+	}
+
+	memcpy(&queue[queue_len], cmd, len);
+	queue_len += len;
+
+	return 0;
+}
+
+static int ftdi_queue_pins(void)
+{
+	const uint8_t cmd[] = { MPSSE_SET_BITS_LOW, pins_value, pins_dir };
+
+	return ftdi_queue(cmd, sizeof(cmd));
+}
+
+/*
+ * Send everything queued so far and collect len bytes of answers
+ */
+static int ftdi_exchange(uint8_t *buf, size_t len)
+{
+	const uint8_t cmd = MPSSE_SEND_IMMEDIATE;
+	struct timespec start, now;
+	size_t done = 0;
+	int ret;
+
+	if (ftdi_queue(&cmd, 1) || ftdi_flush())
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (done < len) {
+		ret = ftdi_read_data(ftdi, buf + done, len - done);
+		if (ret < 0) {
+			fprintf(stderr, "ftdi: read failed: %s\n", ftdi_get_error_string(ftdi));
+			return -1;
+		}
+		done += ret;
+
+		if (ret == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((now.tv_sec - start.tv_sec) * 1000 +
+			    (now.tv_nsec - start.tv_nsec) / 1000000 > FTDI_READ_TIMEOUT_MS) {
+				fprintf(stderr, "ftdi: read timeout\n");
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* TCK = base / (2 * (div + 1)), rounded down to never go above hz */
+static unsigned int ftdi_clock_divisor(unsigned long hz)
+{
+	unsigned long div = DIV_ROUND_UP(FTDI_BASE_HZ, 2 * hz);
+
+	if (div > 0x10000)
+		div = 0x10000;
+
+	return div - 1;
+}
+
+int gpio_init(const struct board *board)
+{
+	unsigned int div = ftdi_clock_divisor(FTDI_CLOCK_HZ);
+	uint8_t cmd[] = {
+		MPSSE_DIS_DIV_5,
+		MPSSE_DIS_ADAPTIVE,
+		MPSSE_DIS_3_PHASE,
+		MPSSE_LOOPBACK_OFF,
+		MPSSE_SET_DIVISOR, div & 0xff, div >> 8,
+	};
+
+	if (!board->usb_vid) {
+		fprintf(stderr, "board %s has no FTDI device\n", board->name);
+		return -1;
+	}
+
+	if (board->cclk != FTDI_CCLK || board->data != FTDI_DATA) {
+		fprintf(stderr, "ftdi: CCLK and DATA must be on ADBUS%d and ADBUS%d\n",
+			FTDI_CCLK, FTDI_DATA);
+		return -1;
+	}
+
+	ftdi = ftdi_new();
+	if (!ftdi) {
+		fprintf(stderr, "ftdi: failed to allocate context\n");
+		return -1;
+	}
+
+	if (ftdi_set_interface(ftdi, INTERFACE_A) < 0 ||
+	    ftdi_usb_open(ftdi, board->usb_vid, board->usb_pid) < 0) {
+		fprintf(stderr, "ftdi: failed to open %04x:%04x: %s\n",
+			board->usb_vid, board->usb_pid, ftdi_get_error_string(ftdi));
+		ftdi_free(ftdi);
+		ftdi = NULL;
+		return -1;
+	}
+
+	if (ftdi_usb_reset(ftdi) < 0 ||
+	    ftdi_set_latency_timer(ftdi, 1) < 0 ||
+	    ftdi_set_bitmode(ftdi, 0, BITMODE_RESET) < 0 ||
+	    ftdi_set_bitmode(ftdi, 0, BITMODE_MPSSE) < 0 ||
+	    ftdi_tcioflush(ftdi) < 0) {
+		fprintf(stderr, "ftdi: failed to enter MPSSE mode: %s\n",
+			ftdi_get_error_string(ftdi));
+		gpio_exit();
+		return -1;
+	}
+
+	pins_value = 0;
+	pins_dir = 0;
+	pins_exported = 0;
+
+	if (ftdi_queue(cmd, sizeof(cmd)) || ftdi_queue_pins() || ftdi_flush()) {
+		gpio_exit();
+		return -1;
+	}
+
+	return 0;
+}
+
+void gpio_exit(void)
+{
+	if (!ftdi)
+		return;
+
+	ftdi_flush();
+	ftdi_set_bitmode(ftdi, 0, BITMODE_RESET);
+	ftdi_usb_close(ftdi);
+	ftdi_free(ftdi);
+	ftdi = NULL;
+}
+
+int gpio_export(int n)
+{
+	if (n < 0 || n > 7 || (1 << n) == FTDI_DI_BIT) {
+		fprintf(stderr, "ftdi: invalid ADBUS pin %d\n", n);
+		return -1;
+	}
+
+	if ((pins_exported & (1 << n)) ||
+	    (!(FTDI_SERIAL_PINS & (1 << n)) && (pins_exported & ~FTDI_SERIAL_PINS))) {
+		fprintf(stderr, "ftdi: ADBUS%d already in use, only a single target "
+			"can be driven\n", n);
+		return -1;
+	}
+
+	pins_exported |= 1 << n;
+
+	return 0;
+}
+
+int gpio_unexport(int n)
+{
+	if (n >= 0 && n <= 7)
+		pins_exported &= ~(1 << n);
+
+	return ftdi_flush();
+}
+
+int gpio_set_direction(int n, enum gpio_direction direction)
+{
+	switch (direction) {
+	case GPIO_DIRECTION_IN:
+		pins_dir &= ~(1 << n);
+		break;
+	case GPIO_DIRECTION_OUT:
+		pins_value &= ~(1 << n);
+		pins_dir |= 1 << n;
+		break;
+	case GPIO_DIRECTION_HIGH:
+		pins_value |= 1 << n;
+		pins_dir |= 1 << n;
+		break;
+	}
+
+	return ftdi_queue_pins();
+}
+
+int gpio_get_value(int n, bool *value)
+{
+	const uint8_t cmd = MPSSE_GET_BITS_LOW;
+	uint8_t pins;
+
+	if (ftdi_queue(&cmd, 1) || ftdi_exchange(&pins, 1))
+		return -1;
+
+	/* the DATA line is read back on DI */
+	if (n == FTDI_DATA)
+		*value = !!(pins & FTDI_DI_BIT);
+	else
+		*value = !!(pins & (1 << n));
+
+	return 0;
+}
+
+int gpio_set_value(int n, bool value)
+{
+	if (value)
+		pins_value |= 1 << n;
+	else
+		pins_value &= ~(1 << n);
+
+	return ftdi_queue_pins();
+}
+
+int gpio_set_values(const int *n, const bool *value, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (value[i])
+			pins_value |= 1 << n[i];
+		else
+			pins_value &= ~(1 << n[i]);
+	}
+
+	return ftdi_queue_pins();
+}
+
+/* the bulk operations run on the serial engine, whatever the target wiring */
+static int ftdi_check_pins(int cclk, int data)
+{
+	if (cclk != FTDI_CCLK || data != FTDI_DATA) {
+		fprintf(stderr, "ftdi: CCLK %d and DATA %d are not ADBUS%d and ADBUS%d\n",
+			cclk, data, FTDI_CCLK, FTDI_DATA);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int ftdi_queue_bytes(uint8_t opcode, const uint8_t *buf, size_t len)
+{
+	uint8_t cmd[3];
+	size_t chunk;
+
+	while (len) {
+		chunk = len < 65536 ? len : 65536;
+
+		cmd[0] = opcode;
+		cmd[1] = (chunk - 1) & 0xff;
+		cmd[2] = (chunk - 1) >> 8;
+
+		if (ftdi_queue(cmd, sizeof(cmd)))
+			return -1;
+		if (buf && ftdi_queue(buf, chunk))
+			return -1;
+
+		if (buf)
+			buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+int gpio_shift_out(int cclk, int data, const uint8_t *buf, size_t len)
+{
+	if (ftdi_check_pins(cclk, data))
+		return -1;
+
+	return ftdi_queue_bytes(MPSSE_WRITE_BYTES_PVE, buf, len);
+}
+
+int gpio_shift_in(int cclk, int data, uint8_t *buf, size_t len)
+{
+	if (ftdi_check_pins(cclk, data))
+		return -1;
+
+	if (ftdi_queue_bytes(MPSSE_READ_BYTES_NVE, NULL, len))
+		return -1;
+
+	return ftdi_exchange(buf, len);
+}
+
+int gpio_clock_pulses(int cclk, unsigned int n)
+{
+	uint8_t cmd[3];
+
+	if (cclk != FTDI_CCLK) {
+		fprintf(stderr, "ftdi: CCLK %d is not ADBUS%d\n", cclk, FTDI_CCLK);
+		return -1;
+	}
+
+	if (n >= 8) {
+		cmd[0] = MPSSE_CLK_BYTES;
+		cmd[1] = (n / 8 - 1) & 0xff;
+		cmd[2] = (n / 8 - 1) >> 8;
+		if (ftdi_queue(cmd, 3))
+			return -1;
+	}
+
+	if (n % 8) {
+		cmd[0] = MPSSE_CLK_BITS;
+		cmd[1] = n % 8 - 1;
+		if (ftdi_queue(cmd, 2))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* TCK is generated by the MPSSE, no software pacing is needed */
+int gpio_set_clock(unsigned long hz)
+{
+	unsigned int div = ftdi_clock_divisor(hz ? hz : FTDI_CLOCK_HZ);
+	uint8_t cmd[] = { MPSSE_SET_DIVISOR, div & 0xff, div >> 8 };
+
+	if (ftdi_queue(cmd, sizeof(cmd)))
+		return -1;
+
+	return ftdi_flush();
+}
+
+/*
+ * Queue a transaction with a speculative ready-wait: DI is sampled
+ * before each answer byte, its reply is 1 + 2 * in_len bytes long
+ */
+static int ftdi_queue_transaction(int cclk, int data, const uint8_t *out, size_t out_len,
+				  size_t in_len)
+{
+	const uint8_t sample = MPSSE_GET_BITS_LOW;
+	size_t i;
+
+	if (gpio_set_direction(data, GPIO_DIRECTION_OUT) ||
+	    gpio_shift_out(cclk, data, out, out_len) ||
+	    gpio_set_direction(data, GPIO_DIRECTION_IN) ||
+	    ftdi_queue(&sample, 1))
+		return -1;
+
+	for (i = 0; i < in_len; i++) {
+		if (ftdi_queue_bytes(MPSSE_READ_BYTES_NVE, NULL, 1) ||
+		    ftdi_queue(&sample, 1))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Complete a transaction queued by ftdi_queue_transaction() from its
+ * reply, sampling again for as long as the chip is not ready
+ */
+static int ftdi_finish_transaction(int cclk, int data, uint8_t *reply, uint8_t *in,
+				   size_t in_len, unsigned int timeout_ms)
+{
+	const uint8_t sample = MPSSE_GET_BITS_LOW;
+	struct timing_deadline d;
+	unsigned int polls = 0;
+	bool first = true;
+	size_t i, k, got;
+
+	for (;;) {
+		/* reply[2 * k] is sample k, reply[2 * i + 1] is byte i */
+		for (k = 0; k <= in_len; k++) {
+			if (!(reply[2 * k] & FTDI_DI_BIT))
+				break;
+		}
+
+		if (k <= in_len) {
+			trace_ready(polls + k);
+
+			/* bytes k and above were answer bytes */
+			got = in_len - k;
+			for (i = 0; i < got; i++)
+				in[i] = reply[2 * (k + i) + 1];
+
+			/* the remaining ones need no further sampling */
+			if (got < in_len)
+				return gpio_shift_in(cclk, data, in + got, in_len - got);
+
+			return 0;
+		}
+
+		/* every byte clocked in was a ready-wait poll */
+		if (first)
+			timing_wait_start(&d, 0, timeout_ms);
+		first = false;
+		polls += in_len;
+		if (timing_wait_poll(&d)) {
+			trace_ready(polls);
+			return -ETIMEDOUT;
+		}
+
+		for (i = 0; i < in_len; i++) {
+			if (ftdi_queue_bytes(MPSSE_READ_BYTES_NVE, NULL, 1) ||
+			    ftdi_queue(&sample, 1))
+				return -1;
+		}
+
+		/* this round follows the last, high, sample of the previous one */
+		reply[0] = FTDI_DI_BIT;
+		if (ftdi_exchange(reply + 1, 2 * in_len))
+			return -1;
+	}
+}
+
+/*
+ * A whole transaction is queued as a single USB write followed by a
+ * single read. The ready-wait is speculative: a DI sample is taken before
+ * each answer byte and after the last one. Clocking a byte in while the
+ * chip is still busy is exactly one ready-wait poll, so if sample k is the
+ * first low one, answer bytes k and above are valid and only k bytes are
+ * left to be read. Nothing is ever clocked past the end of the answer.
+ */
+int gpio_transaction(int cclk, int data, const uint8_t *out, size_t out_len,
+		     uint8_t *in, size_t in_len, unsigned int timeout_ms)
+{
+	uint8_t reply[1 + 2 * FTDI_MAX_ANSWER];
+
+	if (ftdi_check_pins(cclk, data))
+		return -1;
+
+	if (!in_len || in_len > FTDI_MAX_ANSWER) {
+		fprintf(stderr, "ftdi: unsupported answer length %zu\n", in_len);
+		return -1;
+	}
+
+	if (ftdi_queue_transaction(cclk, data, out, out_len, in_len) ||
+	    ftdi_exchange(reply, 1 + 2 * in_len))
+		return -1;
+
+	return ftdi_finish_transaction(cclk, data, reply, in, in_len, timeout_ms);
+}
+
+/*
+ * Batched transactions are all queued into one USB write. Only one DI
+ * sample is taken per transaction, right after the turnaround: queued
+ * commands are expected to answer immediately. If a chip was not ready
+ * the following requests have been clocked into its answer, which is
+ * reported as a loss of synchronisation. A transaction flagged to wait
+ * ends the USB write instead, with the ready-wait of gpio_transaction().
+ */
+int gpio_transactions(int cclk, int data, const struct gpio_xfer *xfer,
+		      unsigned int count, unsigned int timeout_ms)
+{
+	const uint8_t sample = MPSSE_GET_BITS_LOW;
+	const struct gpio_xfer *x;
+	uint8_t reply[1024];
+	unsigned int i, j, n;
+	size_t len, size;
+	bool wait;
+	int ret;
+
+	if (ftdi_check_pins(cclk, data))
+		return -1;
+
+	if (count == 1)
+		return gpio_transaction(cclk, data, xfer->out, xfer->out_len,
+					xfer->in, xfer->in_len, timeout_ms);
+
+	for (i = 0; i < count; i += n) {
+		len = 0;
+		wait = false;
+		for (n = 0; i + n < count && !wait; n++) {
+			x = &xfer[i + n];
+			if (x->wait && (!x->in_len || x->in_len > FTDI_MAX_ANSWER)) {
+				fprintf(stderr, "ftdi: unsupported answer length %zu\n", x->in_len);
+				return -1;
+			}
+
+			size = x->wait ? 1 + 2 * x->in_len : 1 + x->in_len;
+			if (len + size > sizeof(reply))
+				break;
+			len += size;
+			wait = x->wait;
+
+			if (wait) {
+				if (ftdi_queue_transaction(cclk, data, x->out, x->out_len, x->in_len))
+					return -1;
+				continue;
+			}
+
+			if (gpio_set_direction(data, GPIO_DIRECTION_OUT) ||
+			    gpio_shift_out(cclk, data, x->out, x->out_len) ||
+			    gpio_set_direction(data, GPIO_DIRECTION_IN) ||
+			    ftdi_queue(&sample, 1) ||
+			    ftdi_queue_bytes(MPSSE_READ_BYTES_NVE, NULL, x->in_len))
+				return -1;
+		}
+
+		if (ftdi_exchange(reply, len))
+			return -1;
+
+		len = 0;
+		for (j = 0; j < n; j++) {
+			x = &xfer[i + j];
+			/* the last one of this USB write */
+			if (x->wait) {
+				ret = ftdi_finish_transaction(cclk, data, &reply[len], x->in,
+							      x->in_len, timeout_ms);
+				if (ret)
+					return ret;
+				break;
+			}
+
+			if (reply[len] & FTDI_DI_BIT) {
+				fprintf(stderr, "ftdi: chip not ready for queued command %u, "
+					"lost synchronisation\n", i + j);
+				return -EIO;
+			}
+			trace_ready(0);
+
+			memcpy(x->in, &reply[len + 1], x->in_len);
+			len += 1 + x->in_len;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,650 @@
+/*
+ * Memory-mapped GPIO controller backend
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "gpio.h"
+#include "timing.h"
+#ifdef BOARD_STATIC
+#include "board-static.h"
+#endif
+
+#define MMAP_SIZE		4096
+
+/* BCM2835 register offsets, in 32-bit words */
+#define BCM2835_GPFSEL0		(0x00 / 4)
+#define BCM2835_GPSET0		(0x1C / 4)
+#define BCM2835_GPCLR0		(0x28 / 4)
+#define BCM2835_GPLEV0		(0x34 / 4)
+
+/* AM335x register offsets, in 32-bit words */
+#define AM335X_GPIO_OE		(0x134 / 4)
+#define AM335X_GPIO_DATAIN	(0x138 / 4)
+#define AM335X_GPIO_CLRDATAOUT	(0x190 / 4)
+#define AM335X_GPIO_SETDATAOUT	(0x194 / 4)
+
+static enum board_soc soc;
+static volatile uint32_t *banks[BOARD_MAX_BANKS];
+
+/* serializes the read-modify-write of the direction registers */
+static pthread_mutex_t direction_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Resolve the registers of a GPIO: the bank register window and the
+ * bit within the set/clear/level registers of that bank.
+ */
+static volatile uint32_t *gpio_bank(int n, uint32_t *bit)
+{
+	unsigned int bank = n / 32;
+
+	if (n < 0 || bank >= BOARD_MAX_BANKS)
+		return NULL;
+
+	*bit = 1U << (n % 32);
+
+	switch (soc) {
+	case BOARD_SOC_BCM2835:
+		/* a single window, the registers of bank N follow bank 0 */
+		return banks[0] ? banks[0] + bank : NULL;
+	case BOARD_SOC_AM335X:
+		return banks[bank];
+	default:
+		return NULL;
+	}
+}
+
+static volatile uint32_t *map_bank(int fd, off_t base)
+{
+	void *p;
+
+	p = mmap(NULL, MMAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return NULL;
+	}
+
+	return p;
+}
+
+int gpio_init(const struct board *board)
+{
+	unsigned int i;
+	int fd;
+
+	if (board->soc == BOARD_SOC_NONE) {
+		fprintf(stderr, "board %s has no memory-mapped GPIO controller\n",
+				board->name);
+		return -1;
+	}
+
+	soc = board->soc;
+
+	/* /dev/gpiomem exposes the BCM2835 GPIO block without root access */
+	if (soc == BOARD_SOC_BCM2835) {
+		fd = open("/dev/gpiomem", O_RDWR | O_SYNC);
+		if (fd >= 0) {
+			banks[0] = map_bank(fd, 0);
+			close(fd);
+			if (banks[0])
+				return 0;
+		}
+	}
+
+	fd = open("/dev/mem", O_RDWR | O_SYNC);
+	if (fd < 0) {
+		perror("/dev/mem");
+		return -1;
+	}
+
+	for (i = 0; i < BOARD_MAX_BANKS; i++) {
+		if (!board->base[i])
+			continue;
+
+		banks[i] = map_bank(fd, board->base[i]);
+		if (!banks[i]) {
+			close(fd);
+			gpio_exit();
+			return -1;
+		}
+	}
+
+	close(fd);
+
+	return 0;
+}
+
+void gpio_exit(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < BOARD_MAX_BANKS; i++) {
+		if (banks[i])
+			munmap((void *)banks[i], MMAP_SIZE);
+		banks[i] = NULL;
+	}
+}
+
+/*
+ * There is nothing to export, just make sure the GPIO controller
+ * registers for that pin have been mapped
+ */
+int gpio_export(int n)
+{
+	uint32_t bit;
+
+	if (!gpio_bank(n, &bit)) {
+		fprintf(stderr, "GPIO %d is not mapped\n", n);
+		return -1;
+	}
+
+	return 0;
+}
+
+int gpio_unexport(int n)
+{
+	(void)n;
+
+	return 0;
+}
+
+int gpio_set_direction(int n, enum gpio_direction direction)
+{
+	volatile uint32_t *regs;
+	uint32_t bit, fsel;
+	unsigned int shift;
+
+	regs = gpio_bank(n, &bit);
+	if (!regs)
+		return -1;
+
+	if (direction == GPIO_DIRECTION_HIGH)
+		gpio_set_value(n, 1);
+	else if (direction == GPIO_DIRECTION_OUT)
+		gpio_set_value(n, 0);
+
+	pthread_mutex_lock(&direction_lock);
+
+	switch (soc) {
+	case BOARD_SOC_BCM2835:
+		/* 3 function select bits per GPIO, 000 is input, 001 output */
+		regs = banks[0] + BCM2835_GPFSEL0 + n / 10;
+		shift = (n % 10) * 3;
+		fsel = *regs & ~(7U << shift);
+		if (direction != GPIO_DIRECTION_IN)
+			fsel |= 1U << shift;
+		*regs = fsel;
+		break;
+	case BOARD_SOC_AM335X:
+		/* output enable is active low */
+		if (direction == GPIO_DIRECTION_IN)
+			regs[AM335X_GPIO_OE] |= bit;
+		else
+			regs[AM335X_GPIO_OE] &= ~bit;
+		break;
+	default:
+		break;
+	}
+
+	pthread_mutex_unlock(&direction_lock);
+
+	return 0;
+}
+
+int gpio_get_value(int n, bool *value)
+{
+	volatile uint32_t *regs;
+	uint32_t bit;
+
+	regs = gpio_bank(n, &bit);
+	if (!regs)
+		return -1;
+
+	if (soc == BOARD_SOC_BCM2835)
+		*value = !!(regs[BCM2835_GPLEV0] & bit);
+	else
+		*value = !!(regs[AM335X_GPIO_DATAIN] & bit);
+
+	return 0;
+}
+
+static inline void gpio_write_masks(volatile uint32_t *regs, uint32_t set, uint32_t clr)
+{
+	/* clear first so that a data bit is settled when the clock rises */
+	if (soc == BOARD_SOC_BCM2835) {
+		if (clr)
+			regs[BCM2835_GPCLR0] = clr;
+		if (set)
+			regs[BCM2835_GPSET0] = set;
+	} else {
+		if (clr)
+			regs[AM335X_GPIO_CLRDATAOUT] = clr;
+		if (set)
+			regs[AM335X_GPIO_SETDATAOUT] = set;
+	}
+}
+
+int gpio_set_value(int n, bool value)
+{
+	volatile uint32_t *regs;
+	uint32_t bit;
+
+	regs = gpio_bank(n, &bit);
+	if (!regs)
+		return -1;
+
+	gpio_write_masks(regs, value ? bit : 0, value ? 0 : bit);
+
+	return 0;
+}
+
+int gpio_set_values(const int *n, const bool *value, unsigned int count)
+{
+	volatile uint32_t *regs[BOARD_MAX_BANKS] = { NULL };
+	uint32_t set[BOARD_MAX_BANKS] = { 0 };
+	uint32_t clr[BOARD_MAX_BANKS] = { 0 };
+	volatile uint32_t *bank;
+	uint32_t bit;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		bank = gpio_bank(n[i], &bit);
+		if (!bank)
+			return -1;
+
+		regs[n[i] / 32] = bank;
+
+		if (value[i])
+			set[n[i] / 32] |= bit;
+		else
+			clr[n[i] / 32] |= bit;
+	}
+
+	for (i = 0; i < BOARD_MAX_BANKS; i++) {
+		if (regs[i])
+			gpio_write_masks(regs[i], set[i], clr[i]);
+	}
+
+	return 0;
+}
+
+/*
+ * Bulk operations: resolve the registers and masks once and then only
+ * issue volatile stores in the bit loops.
+ */
+struct mmap_pin {
+	volatile uint32_t *set;
+	volatile uint32_t *clr;
+	volatile uint32_t *lev;
+	uint32_t bit;
+};
+
+static int mmap_pin(int n, struct mmap_pin *pin)
+{
+	volatile uint32_t *regs;
+
+	regs = gpio_bank(n, &pin->bit);
+	if (!regs)
+		return -1;
+
+	if (soc == BOARD_SOC_BCM2835) {
+		pin->set = &regs[BCM2835_GPSET0];
+		pin->clr = &regs[BCM2835_GPCLR0];
+		pin->lev = &regs[BCM2835_GPLEV0];
+	} else {
+		pin->set = &regs[AM335X_GPIO_SETDATAOUT];
+		pin->clr = &regs[AM335X_GPIO_CLRDATAOUT];
+		pin->lev = &regs[AM335X_GPIO_DATAIN];
+	}
+
+	return 0;
+}
+
+/*
+ * Kernels specialized at build time for the wiring of one board (make
+ * BOARD=<name>): the register offsets, CCLK and DATA bits are constants
+ * and each byte is 8 unrolled bit times of straight-line stores. They
+ * are used when the backend runs that SoC and a transfer is on those
+ * pins, any other wiring goes through the generic loops.
+ */
+#if defined(BOARD_STATIC) && BOARD_STATIC_CCLK / 32 == BOARD_STATIC_DATA / 32 && \
+	(defined(BOARD_STATIC_BCM2835) || defined(BOARD_STATIC_AM335X))
+#define MMAP_STATIC_KERNELS
+
+#if defined(BOARD_STATIC_BCM2835)
+#define STATIC_SET		BCM2835_GPSET0
+#define STATIC_CLR		BCM2835_GPCLR0
+#define STATIC_LEV		BCM2835_GPLEV0
+#define static_regs()		(banks[0] ? banks[0] + BOARD_STATIC_CCLK / 32 : NULL)
+#else
+#define STATIC_SET		AM335X_GPIO_SETDATAOUT
+#define STATIC_CLR		AM335X_GPIO_CLRDATAOUT
+#define STATIC_LEV		AM335X_GPIO_DATAIN
+#define static_regs()		(banks[BOARD_STATIC_CCLK / 32])
+#endif
+
+#define STATIC_CLK_BIT		(1U << (BOARD_STATIC_CCLK % 32))
+#define STATIC_DATA_SHIFT	(BOARD_STATIC_DATA % 32)
+#define STATIC_DATA_BIT		(1U << STATIC_DATA_SHIFT)
+
+/* the DATA bit is settled (cleared or set with CCLK) before CCLK falls */
+#define STATIC_OUT_BIT(regs, byte, b)					\
+	do {								\
+		uint32_t d = (((byte) >> (b)) & 1U) << STATIC_DATA_SHIFT; \
+		(regs)[STATIC_CLR] = STATIC_DATA_BIT ^ d;		\
+		(regs)[STATIC_SET] = STATIC_CLK_BIT | d;		\
+		timing_edge();						\
+		(regs)[STATIC_CLR] = STATIC_CLK_BIT;			\
+		timing_edge();						\
+	} while (0)
+
+#define STATIC_IN_BIT(regs, byte, b)					\
+	do {								\
+		(regs)[STATIC_SET] = STATIC_CLK_BIT;			\
+		timing_edge();						\
+		(byte) |= (((regs)[STATIC_LEV] >> STATIC_DATA_SHIFT) & 1U) << (b); \
+		(regs)[STATIC_CLR] = STATIC_CLK_BIT;			\
+		timing_edge();						\
+	} while (0)
+
+static inline volatile uint32_t *static_pins(int cclk, int data)
+{
+	if (soc != BOARD_STATIC_SOC || cclk != BOARD_STATIC_CCLK ||
+	    data != BOARD_STATIC_DATA)
+		return NULL;
+
+	return static_regs();
+}
+
+static inline void static_shift_out(volatile uint32_t *regs, const uint8_t *buf,
+				    size_t len)
+{
+	uint32_t byte;
+
+	while (len--) {
+		byte = *buf++;
+		STATIC_OUT_BIT(regs, byte, 7);
+		STATIC_OUT_BIT(regs, byte, 6);
+		STATIC_OUT_BIT(regs, byte, 5);
+		STATIC_OUT_BIT(regs, byte, 4);
+		STATIC_OUT_BIT(regs, byte, 3);
+		STATIC_OUT_BIT(regs, byte, 2);
+		STATIC_OUT_BIT(regs, byte, 1);
+		STATIC_OUT_BIT(regs, byte, 0);
+	}
+}
+
+static inline void static_shift_in(volatile uint32_t *regs, uint8_t *buf, size_t len)
+{
+	uint32_t byte;
+
+	while (len--) {
+		byte = 0;
+		STATIC_IN_BIT(regs, byte, 7);
+		STATIC_IN_BIT(regs, byte, 6);
+		STATIC_IN_BIT(regs, byte, 5);
+		STATIC_IN_BIT(regs, byte, 4);
+		STATIC_IN_BIT(regs, byte, 3);
+		STATIC_IN_BIT(regs, byte, 2);
+		STATIC_IN_BIT(regs, byte, 1);
+		STATIC_IN_BIT(regs, byte, 0);
+		*buf++ = byte;
+	}
+}
+
+static inline void static_clock_pulses(volatile uint32_t *regs, unsigned int n)
+{
+	while (n--) {
+		regs[STATIC_SET] = STATIC_CLK_BIT;
+		timing_edge();
+		regs[STATIC_CLR] = STATIC_CLK_BIT;
+		timing_edge();
+	}
+}
+#endif /* MMAP_STATIC_KERNELS */
+
+int gpio_shift_out(int cclk, int data, const uint8_t *buf, size_t len)
+{
+#ifdef MMAP_STATIC_KERNELS
+	volatile uint32_t *regs = static_pins(cclk, data);
+
+	if (regs) {
+		static_shift_out(regs, buf, len);
+		return 0;
+	}
+#endif
+	/* a single target is the same precomputed, branchless edge loop */
+	return gpio_gang_shift_out(&cclk, &data, &buf, 1, len);
+}
+
+int gpio_shift_in(int cclk, int data, uint8_t *buf, size_t len)
+{
+	struct mmap_pin clk, dat;
+	size_t i;
+	int bit;
+
+#ifdef MMAP_STATIC_KERNELS
+	volatile uint32_t *regs = static_pins(cclk, data);
+
+	if (regs) {
+		static_shift_in(regs, buf, len);
+		return 0;
+	}
+#endif
+	if (mmap_pin(cclk, &clk) || mmap_pin(data, &dat))
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = 0;
+		for (bit = 7; bit >= 0; bit--) {
+			*clk.set = clk.bit;
+			timing_edge();
+			if (*dat.lev & dat.bit)
+				buf[i] |= (1 << bit);
+			*clk.clr = clk.bit;
+			timing_edge();
+		}
+	}
+
+	return 0;
+}
+
+int gpio_clock_pulses(int cclk, unsigned int n)
+{
+	struct mmap_pin clk;
+
+#ifdef MMAP_STATIC_KERNELS
+	volatile uint32_t *regs = static_pins(cclk, BOARD_STATIC_DATA);
+
+	if (regs) {
+		static_clock_pulses(regs, n);
+		return 0;
+	}
+#endif
+	if (mmap_pin(cclk, &clk))
+		return -1;
+
+	while (n--) {
+		*clk.set = clk.bit;
+		timing_edge();
+		*clk.clr = clk.bit;
+		timing_edge();
+	}
+
+	return 0;
+}
+
+/*
+ * Lock-step shift out for several targets, in two stages so that the
+ * edge loop is only made of stores:
+ *
+ * - bit slicing: for each byte position, the bytes of all the targets
+ *   are transposed into 8 target masks, one per bit time (bit t set
+ *   when target t sends a 1), with SSE2 movemask or NEON when possible;
+ * - each target mask is then turned into the clear and set words of
+ *   every bank through per-nibble lookup tables.
+ *
+ * Each bit time clears the DATA lines sending a 0, sets the ones sending
+ * a 1 together with CCLK, then clears CCLK: all the DATA lines are
+ * settled before the falling edge, where the targets sample them. The
+ * only other work in the edge loop is the (predictable) pacing check.
+ */
+#define GANG_MAX_TARGETS	16
+#define GANG_CHUNK		64	/* bytes precomputed at once */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+struct gang_bank {
+	volatile uint32_t *set;
+	volatile uint32_t *clr;
+	uint32_t clk;
+	uint32_t data;
+	/* DATA bits of the targets in a nibble of a target mask */
+	uint32_t lut[GANG_MAX_TARGETS / 4][16];
+};
+
+/* masks[0] is for the MSB, which is sent first */
+static inline void gang_slice(const uint8_t *bytes, uint32_t masks[8])
+{
+#if defined(__SSE2__)
+	__m128i v = _mm_loadu_si128((const __m128i *)bytes);
+	int b;
+
+	for (b = 0; b < 8; b++) {
+		masks[b] = _mm_movemask_epi8(v);
+		v = _mm_add_epi8(v, v);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	static const int8_t lane_shift[16] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7
+	};
+	const int8x16_t shift = vld1q_s8(lane_shift);
+	uint8x16_t v = vld1q_u8(bytes);
+	uint8x16_t bits;
+	int b;
+
+	for (b = 0; b < 8; b++) {
+		/* MSB of each lane moved to bit (lane % 8), then summed per half */
+		bits = vshlq_u8(vshrq_n_u8(v, 7), shift);
+		masks[b] = vaddv_u8(vget_low_u8(bits)) |
+			   (vaddv_u8(vget_high_u8(bits)) << 8);
+		v = vshlq_n_u8(v, 1);
+	}
+#else
+	unsigned int t;
+	int b;
+
+	for (b = 0; b < 8; b++) {
+		masks[b] = 0;
+		for (t = 0; t < GANG_MAX_TARGETS; t++)
+			masks[b] |= ((bytes[t] >> (7 - b)) & 1U) << t;
+	}
+#endif
+}
+
+int gpio_gang_shift_out(const int *cclk, const int *data, const uint8_t *const *buf,
+			unsigned int count, size_t len)
+{
+	struct gang_bank gb[BOARD_MAX_BANKS];
+	int bank_of[BOARD_MAX_BANKS];
+	uint32_t words[GANG_CHUNK * 8][BOARD_MAX_BANKS][2];
+	uint8_t bytes[GANG_MAX_TARGETS] = { 0 };
+	uint32_t masks[8], set;
+	unsigned int nb = 0, b, t, j, k, n, bit;
+	struct mmap_pin pin;
+	size_t i, chunk;
+
+	if (count > GANG_MAX_TARGETS)
+		return -EINVAL;
+
+	memset(gb, 0, sizeof(gb));
+	for (b = 0; b < BOARD_MAX_BANKS; b++)
+		bank_of[b] = -1;
+
+	/* the banks in use, with their CCLK and DATA bits */
+	for (t = 0; t < 2 * count; t++) {
+		n = t < count ? cclk[t] : data[t - count];
+		if (mmap_pin(n, &pin))
+			return -1;
+
+		b = n / 32;
+		if (bank_of[b] < 0) {
+			bank_of[b] = nb;
+			gb[nb].set = pin.set;
+			gb[nb].clr = pin.clr;
+			nb++;
+		}
+
+		if (t < count) {
+			gb[bank_of[b]].clk |= pin.bit;
+			continue;
+		}
+
+		gb[bank_of[b]].data |= pin.bit;
+		for (k = 0; k < 16; k++) {
+			if (k & (1 << ((t - count) % 4)))
+				gb[bank_of[b]].lut[(t - count) / 4][k] |= pin.bit;
+		}
+	}
+
+	for (i = 0; i < len; i += chunk) {
+		chunk = len - i < GANG_CHUNK ? len - i : GANG_CHUNK;
+
+		for (j = 0; j < chunk; j++) {
+			for (t = 0; t < count; t++)
+				bytes[t] = buf[t][i + j];
+			gang_slice(bytes, masks);
+
+			for (bit = 0; bit < 8; bit++) {
+				for (b = 0; b < nb; b++) {
+					set = gb[b].lut[0][masks[bit] & 0xf] |
+					      gb[b].lut[1][(masks[bit] >> 4) & 0xf] |
+					      gb[b].lut[2][(masks[bit] >> 8) & 0xf] |
+					      gb[b].lut[3][(masks[bit] >> 12) & 0xf];
+					words[j * 8 + bit][b][0] = gb[b].data & ~set;
+					words[j * 8 + bit][b][1] = set | gb[b].clk;
+				}
+			}
+		}
+
+		if (nb == 1) {
+			for (k = 0; k < chunk * 8; k++) {
+				*gb[0].clr = words[k][0][0];
+				*gb[0].set = words[k][0][1];
+				timing_edge();
+				*gb[0].clr = gb[0].clk;
+				timing_edge();
+			}
+			continue;
+		}
+
+		for (k = 0; k < chunk * 8; k++) {
+			for (b = 0; b < nb; b++) {
+				*gb[b].clr = words[k][b][0];
+				*gb[b].set = words[k][b][1];
+			}
+			timing_edge();
+			for (b = 0; b < nb; b++)
+				*gb[b].clr = gb[b].clk;
+			timing_edge();
+		}
+	}
+
+	return 0;
+}
@@ -12,11 +12,43 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "gpio.h"
 
 #define SYSFS_GPIO	"/sys/class/gpio"
 
+/*
+ * The value and direction files of the exported GPIOs are opened once
+ * in gpio_export() and kept open until gpio_unexport(), clocking data
+ * out is then a single pwrite() per edge instead of open/write/close.
+ */
+#define MAX_GPIOS	32
+
+struct sysfs_gpio {
+	int n;
+	int value_fd;
+	int direction_fd;
+};
+
+static struct sysfs_gpio sysfs_gpios[MAX_GPIOS];
+static unsigned int num_sysfs_gpios;
+
+/* held for writing while GPIOs are added or removed from the table */
+static pthread_rwlock_t gpios_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static struct sysfs_gpio *find_gpio(int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_sysfs_gpios; i++) {
+		if (sysfs_gpios[i].n == n)
+			return &sysfs_gpios[i];
+	}
+
+	return NULL;
+}
+
 int read_file(const char *path, char *str, size_t size)
 {
 	int fd;
@@ -66,20 +98,91 @@ int write_file(const char *path, const char *str)
 }
 
 
+int gpio_init(const struct board *board)
+{
+	(void)board;
+
+	return 0;
+}
+
+void gpio_exit(void)
+{
+}
+
+static int open_gpio_file(int n, const char *name, int flags)
+{
+	char path[128];
+	int fd;
+
+	snprintf(path, sizeof (path), SYSFS_GPIO "/gpio%d/%s", n, name);
+
+	fd = open(path, flags);
+	if (fd < 0)
+		perror(path);
+
+	return fd;
+}
+
 int
 gpio_export(int n)
 {
+	struct sysfs_gpio *gpio;
 	char buf[16];
+	int ret;
 
 	snprintf(buf, sizeof (buf), "%d", n);
 
-	return write_file(SYSFS_GPIO "/export", buf);
+	ret = write_file(SYSFS_GPIO "/export", buf);
+	if (ret)
+		return ret;
+
+	pthread_rwlock_wrlock(&gpios_lock);
+
+	if (find_gpio(n))
+		goto out;
+
+	if (num_sysfs_gpios == MAX_GPIOS) {
+		fprintf(stderr, "too many exported GPIOs\n");
+		ret = -1;
+		goto out;
+	}
+
+	gpio = &sysfs_gpios[num_sysfs_gpios];
+	gpio->n = n;
+
+	gpio->value_fd = open_gpio_file(n, "value", O_RDWR);
+	if (gpio->value_fd < 0) {
+		ret = -1;
+		goto out;
+	}
+
+	gpio->direction_fd = open_gpio_file(n, "direction", O_WRONLY);
+	if (gpio->direction_fd < 0) {
+		close(gpio->value_fd);
+		ret = -1;
+		goto out;
+	}
+
+	num_sysfs_gpios++;
+out:
+	pthread_rwlock_unlock(&gpios_lock);
+	return ret;
 }
 
 int gpio_unexport(int n)
 {
+	struct sysfs_gpio *gpio;
 	char buf[16];
 
+	pthread_rwlock_wrlock(&gpios_lock);
+	gpio = find_gpio(n);
+	if (gpio) {
+		close(gpio->value_fd);
+		close(gpio->direction_fd);
+		*gpio = sysfs_gpios[--num_sysfs_gpios];
+	}
+	pthread_rwlock_unlock(&gpios_lock);
+
 	snprintf(buf, sizeof(buf), "%d", n);
 
 	return write_file(SYSFS_GPIO "/unexport", buf);
@@ -93,7 +196,22 @@ gpio_set_direction(int n, enum gpio_direction direction)
 		[GPIO_DIRECTION_OUT]	= "out",
 		[GPIO_DIRECTION_HIGH]	= "high",
 	};
+	struct sysfs_gpio *gpio;
 	char path[128];
+	int ret = 0;
+
+	pthread_rwlock_rdlock(&gpios_lock);
+	gpio = find_gpio(n);
+	if (gpio) {
+		if (pwrite(gpio->direction_fd, str[direction],
+			   strlen(str[direction]), 0) < 0) {
+			perror("pwrite");
+			ret = -1;
+		}
+	}
+	pthread_rwlock_unlock(&gpios_lock);
+	if (gpio)
+		return ret;
 
 	snprintf(path, sizeof (path), SYSFS_GPIO "/gpio%d/direction", n);
 
@@ -103,12 +221,26 @@ gpio_set_direction(int n, enum gpio_direction direction)
 int
 gpio_get_value(int n, bool *value)
 {
+	struct sysfs_gpio *gpio;
 	char buf[128];
+	int ret = 0;
 
-	snprintf(buf, sizeof (buf), SYSFS_GPIO "/gpio%d/value", n);
+	pthread_rwlock_rdlock(&gpios_lock);
+	gpio = find_gpio(n);
+	if (gpio && pread(gpio->value_fd, buf, 1, 0) != 1) {
+		perror("pread");
+		ret = -1;
+	}
+	pthread_rwlock_unlock(&gpios_lock);
+	if (ret)
+		return ret;
 
-	if (read_file(buf, buf, sizeof (buf)) < 0)
-		return -1;
+	if (!gpio) {
+		snprintf(buf, sizeof (buf), SYSFS_GPIO "/gpio%d/value", n);
+
+		if (read_file(buf, buf, sizeof (buf)) < 0)
+			return -1;
+	}
 
 	*value = (*buf != '0');
 
@@ -118,7 +250,19 @@ gpio_get_value(int n, bool *value)
 int
 gpio_set_value(int n, bool value)
 {
+	struct sysfs_gpio *gpio;
 	char path[128];
+	int ret = 0;
+
+	pthread_rwlock_rdlock(&gpios_lock);
+	gpio = find_gpio(n);
+	if (gpio && pwrite(gpio->value_fd, value ? "1" : "0", 1, 0) != 1) {
+		perror("pwrite");
+		ret = -1;
+	}
+	pthread_rwlock_unlock(&gpios_lock);
+	if (gpio)
+		return ret;
 
 	snprintf(path, sizeof (path), SYSFS_GPIO "/gpio%d/value", n);
 
@@ -6,12 +6,12 @@
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 
-/* Reset polarity is active low */
-#define RST_GPIO        0
-#define  RST_GPIO_POL   !       /* Active low polarity */
-#define CCLK_GPIO       1
-#define DATA_GPIO       2
+#include "board.h"
+
+#define __weak		__attribute__((weak))
 
 /*
  * gpio sysfs helpers
@@ -22,10 +22,69 @@ enum gpio_direction {
 	GPIO_DIRECTION_HIGH,
 };
 
+int gpio_init(const struct board *board);
+void gpio_exit(void);
 int gpio_export(int n);
 int gpio_unexport(int n);
 int gpio_set_direction(int n, enum gpio_direction direction);
 int gpio_get_value(int n, bool *value);
 int gpio_set_value(int n, bool value);
 
+/*
+ * Optional operations, generic versions built on the ones above are
+ * provided by gpio-bitbang.c for backends which do not implement them.
+ */
+
+/* set several GPIOs at once, atomically if the backend supports it */
+int gpio_set_values(const int *n, const bool *value, unsigned int count);
+/* clock out/in bytes MSB first on the DATA line */
+int gpio_shift_out(int cclk, int data, const uint8_t *buf, size_t len);
+int gpio_shift_in(int cclk, int data, uint8_t *buf, size_t len);
+/* pulse the clock line n times */
+int gpio_clock_pulses(int cclk, unsigned int n);
+/*
+ * Limit the debug clock to hz, 0 lets it run as fast as the backend
+ * goes. The generic version paces the bit-banged edges in software.
+ */
+int gpio_set_clock(unsigned long hz);
+/*
+ * Run a complete debug port transaction: clock out a request, turn the
+ * DATA line around, wait for the target to pull it low (clocking it 8
+ * times per poll, backing off between polls, for at most timeout_ms)
+ * and clock in the answer. Returns -ETIMEDOUT when the target never
+ * gets ready.
+ */
+int gpio_transaction(int cclk, int data, const uint8_t *out, size_t out_len,
+		     uint8_t *in, size_t in_len, unsigned int timeout_ms);
+
+/*
+ * Run several transactions back to back, which lets the backend send
+ * them in one go. The answer of a transaction is only available once
+ * the whole batch has completed. Transactions are expected to answer
+ * right away, unless flagged with wait (e.g. burst writes).
+ */
+struct gpio_xfer {
+	const uint8_t *out;
+	size_t out_len;
+	uint8_t *in;
+	size_t in_len;
+	bool wait;
+};
+
+int gpio_transactions(int cclk, int data, const struct gpio_xfer *xfer,
+		      unsigned int count, unsigned int timeout_ms);
+
+/*
+ * Clock out one buffer per target in lock-step: every clock edge of
+ * all the targets is a single operation, each DATA line carrying its
+ * own buffer. Returns -ENOSYS when the backend cannot do it, targets
+ * are then driven independently. A count of 0 only checks support.
+ */
+int gpio_gang_shift_out(const int *cclk, const int *data, const uint8_t *const *buf,
+			unsigned int count, size_t len);
+
+/* set up an alternate transport overriding some of the operations */
+int gpio_transport_init(const struct board *board);
+void gpio_transport_exit(void);
+
 #endif /* __CC2530PROG_GPIO_H */
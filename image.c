@@ -0,0 +1,619 @@
+/*
+ * Firmware image handling
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "image.h"
+
+static int image_add_segment(struct image *img, uint32_t addr, uint32_t len, uint8_t *data)
+{
+	struct image_segment *segs;
+
+	segs = realloc(img->segs, (img->num_segs + 1) * sizeof(*segs));
+	if (!segs) {
+		perror("realloc");
+		return -1;
+	}
+
+	img->segs = segs;
+	segs[img->num_segs].addr = addr;
+	segs[img->num_segs].len = len;
+	segs[img->num_segs].data = data;
+	img->num_segs++;
+
+	return 0;
+}
+
+/*
+ * Append data at addr, extending the last segment when contiguous
+ */
+static int image_add_data(struct image *img, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+	struct image_segment *seg;
+	uint8_t *buf;
+
+	if (!len)
+		return 0;
+
+	seg = img->num_segs ? &img->segs[img->num_segs - 1] : NULL;
+	if (seg && seg->addr + seg->len == addr) {
+		buf = realloc(seg->data, seg->len + len);
+		if (!buf) {
+			perror("realloc");
+			return -1;
+		}
+		memcpy(buf + seg->len, data, len);
+		seg->data = buf;
+		seg->len += len;
+		return 0;
+	}
+
+	buf = malloc(len);
+	if (!buf) {
+		perror("malloc");
+		return -1;
+	}
+	memcpy(buf, data, len);
+
+	if (image_add_segment(img, addr, len, buf)) {
+		free(buf);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int seg_cmp(const void *a, const void *b)
+{
+	const struct image_segment *sa = a, *sb = b;
+
+	if (sa->addr == sb->addr)
+		return 0;
+
+	return sa->addr < sb->addr ? -1 : 1;
+}
+
+/*
+ * Sort the segments by address, merge the adjacent ones and reject
+ * overlapping ones
+ */
+static int image_sort(struct image *img)
+{
+	struct image_segment *prev, *seg;
+	unsigned int i, n = 0;
+	uint8_t *buf;
+
+	if (!img->num_segs)
+		return 0;
+
+	qsort(img->segs, img->num_segs, sizeof(img->segs[0]), seg_cmp);
+
+	for (i = 1; i < img->num_segs; i++) {
+		prev = &img->segs[n];
+		seg = &img->segs[i];
+
+		if (seg->addr < prev->addr + prev->len) {
+			fprintf(stderr, "overlapping segments at 0x%05x\n", seg->addr);
+			return -1;
+		}
+
+		if (seg->addr > prev->addr + prev->len) {
+			img->segs[++n] = *seg;
+			if (n != i)
+				seg->data = NULL;
+			continue;
+		}
+
+		buf = realloc(prev->data, prev->len + seg->len);
+		if (!buf) {
+			perror("realloc");
+			return -1;
+		}
+		memcpy(buf + prev->len, seg->data, seg->len);
+		free(seg->data);
+		seg->data = NULL;
+		prev->data = buf;
+		prev->len += seg->len;
+	}
+
+	img->num_segs = n + 1;
+
+	return 0;
+}
+
+static int hex_byte(const char *p)
+{
+	int hi, lo;
+
+	if (!isxdigit((unsigned char)p[0]) || !isxdigit((unsigned char)p[1]))
+		return -1;
+
+	hi = isdigit((unsigned char)p[0]) ? p[0] - '0' : (tolower((unsigned char)p[0]) - 'a' + 10);
+	lo = isdigit((unsigned char)p[1]) ? p[1] - '0' : (tolower((unsigned char)p[1]) - 'a' + 10);
+
+	return (hi << 4) | lo;
+}
+
+/*
+ * Decode the byte count, address, type, data and checksum of a record
+ * following its ':' into rec, returns their number or -1 if the digits
+ * are missing
+ */
+static int ihex_decode(const char *p, uint8_t *rec)
+{
+	unsigned int len, i;
+	int b;
+
+	b = hex_byte(p);
+	if (b < 0)
+		return -1;
+	len = b + 5;
+
+	for (i = 0; i < len; i++) {
+		b = hex_byte(p + 2 * i);
+		if (b < 0)
+			return -1;
+		rec[i] = b;
+	}
+
+	return len;
+}
+
+static uint8_t ihex_sum(const uint8_t *rec, unsigned int len)
+{
+	uint8_t sum = 0;
+
+	while (len--)
+		sum += *rec++;
+
+	return sum;
+}
+
+/*
+ * A raw binary may start with ':' too, a file is only taken for Intel HEX
+ * when its first line is a whole record with a valid checksum
+ */
+static bool ihex_first_line(const char *buf)
+{
+	uint8_t rec[256 + 5];
+	int len;
+
+	if (buf[0] != ':')
+		return false;
+
+	len = ihex_decode(buf + 1, rec);
+	if (len < 0 || ihex_sum(rec, len))
+		return false;
+
+	buf += 1 + 2 * len;
+
+	return *buf == '\r' || *buf == '\n' || *buf == '\0';
+}
+
+/*
+ * Intel HEX: data (00), end of file (01), extended segment address (02)
+ * and extended linear address (04) records, start addresses are ignored
+ */
+static int image_load_ihex(struct image *img, FILE *f)
+{
+	char line[1024];
+	uint8_t rec[256 + 5];
+	uint32_t base = 0;
+	unsigned int lineno = 0;
+	char *p;
+	int len;
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		p = line;
+		while (isspace((unsigned char)*p))
+			p++;
+		if (!*p)
+			continue;
+
+		if (*p++ != ':')
+			goto bad;
+
+		/* byte count, address (2), type, data, checksum */
+		len = ihex_decode(p, rec);
+		if (len < 0)
+			goto bad;
+
+		if (ihex_sum(rec, len)) {
+			fprintf(stderr, "line %d: bad checksum\n", lineno);
+			return -1;
+		}
+
+		switch (rec[3]) {
+		case 0x00:
+			if (image_add_data(img, base + ((rec[1] << 8) | rec[2]), rec + 4, rec[0]))
+				return -1;
+			break;
+		case 0x01:
+			return image_sort(img);
+		case 0x02:
+			if (rec[0] != 2)
+				goto bad;
+			base = ((rec[4] << 8) | rec[5]) << 4;
+			break;
+		case 0x04:
+			if (rec[0] != 2)
+				goto bad;
+			base = ((rec[4] << 8) | rec[5]) << 16;
+			break;
+		case 0x03:
+		case 0x05:
+			break;
+		default:
+			fprintf(stderr, "line %d: unknown record type %02x\n", lineno, rec[3]);
+			return -1;
+		}
+	}
+
+	fprintf(stderr, "missing end of file record\n");
+	return -1;
+
+bad:
+	fprintf(stderr, "line %d: malformed record\n", lineno);
+	return -1;
+}
+
+static uint32_t elf_word(const uint8_t *p, bool msb, unsigned int size)
+{
+	uint32_t v = 0;
+	unsigned int i;
+
+	for (i = 0; i < size; i++)
+		v |= (uint32_t)p[msb ? size - 1 - i : i] << (8 * i);
+
+	return v;
+}
+
+/*
+ * ELF32: the file contents of the PT_LOAD segments are loaded at their
+ * physical (load) address
+ */
+static int image_load_elf(struct image *img, FILE *f)
+{
+	uint8_t ehdr[sizeof(Elf32_Ehdr)];
+	uint8_t phdr[sizeof(Elf32_Phdr)];
+	uint32_t phoff, offset, paddr, filesz;
+	unsigned int phentsize, phnum, i;
+	uint8_t *data;
+	bool msb;
+	int ret;
+
+	if (fread(ehdr, sizeof(ehdr), 1, f) != 1)
+		goto bad;
+
+	if (ehdr[EI_CLASS] != ELFCLASS32) {
+		fprintf(stderr, "only 32-bit ELF files are supported\n");
+		return -1;
+	}
+
+	msb = ehdr[EI_DATA] == ELFDATA2MSB;
+	phoff = elf_word(ehdr + offsetof(Elf32_Ehdr, e_phoff), msb, 4);
+	phentsize = elf_word(ehdr + offsetof(Elf32_Ehdr, e_phentsize), msb, 2);
+	phnum = elf_word(ehdr + offsetof(Elf32_Ehdr, e_phnum), msb, 2);
+
+	if (phentsize < sizeof(phdr))
+		goto bad;
+
+	for (i = 0; i < phnum; i++) {
+		if (fseek(f, phoff + i * phentsize, SEEK_SET) ||
+		    fread(phdr, sizeof(phdr), 1, f) != 1)
+			goto bad;
+
+		if (elf_word(phdr + offsetof(Elf32_Phdr, p_type), msb, 4) != PT_LOAD)
+			continue;
+
+		offset = elf_word(phdr + offsetof(Elf32_Phdr, p_offset), msb, 4);
+		paddr = elf_word(phdr + offsetof(Elf32_Phdr, p_paddr), msb, 4);
+		filesz = elf_word(phdr + offsetof(Elf32_Phdr, p_filesz), msb, 4);
+		if (!filesz)
+			continue;
+
+		data = malloc(filesz);
+		if (!data) {
+			perror("malloc");
+			return -1;
+		}
+
+		if (fseek(f, offset, SEEK_SET) || fread(data, filesz, 1, f) != 1) {
+			free(data);
+			goto bad;
+		}
+
+		ret = image_add_data(img, paddr, data, filesz);
+		free(data);
+		if (ret)
+			return -1;
+	}
+
+	return image_sort(img);
+
+bad:
+	fprintf(stderr, "truncated or malformed ELF file\n");
+	return -1;
+}
+
+/*
+ * Raw binary, loaded at address 0: the file is mapped read-only and the
+ * segment points straight into the page cache
+ */
+static int image_load_raw(struct image *img, int fd, off_t size)
+{
+	void *map;
+
+	if (!size)
+		return 0;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	img->map = map;
+	img->map_len = size;
+
+	return image_add_segment(img, 0, size, map);
+}
+
+int image_load(struct image *img, const char *path)
+{
+	/* long enough for the first record of a HEX file */
+	char head[1 + 2 * (256 + 5) + 2];
+	struct stat buf;
+	bool ihex;
+	ssize_t n;
+	FILE *f;
+	int fd, ret;
+
+	memset(img, 0, sizeof(*img));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	if (fstat(fd, &buf) < 0) {
+		perror("fstat");
+		close(fd);
+		return -1;
+	}
+
+	if (!S_ISREG(buf.st_mode)) {
+		fprintf(stderr, "%s is not a regular file\n", path);
+		close(fd);
+		return -1;
+	}
+
+	n = read(fd, head, sizeof(head) - 1);
+	if (n < 0 || lseek(fd, 0, SEEK_SET) < 0)
+		n = 0;
+	head[n] = '\0';
+	ihex = ihex_first_line(head);
+
+	if ((n >= SELFMAG && !memcmp(head, ELFMAG, SELFMAG)) || ihex) {
+		f = fdopen(fd, "r");
+		if (!f) {
+			perror("fdopen");
+			close(fd);
+			return -1;
+		}
+
+		if (ihex)
+			ret = image_load_ihex(img, f);
+		else
+			ret = image_load_elf(img, f);
+		fclose(f);
+	} else {
+		if (head[0] == ':')
+			fprintf(stderr, "%s does not start with an Intel HEX record, "
+				"loading it as a raw binary\n", path);
+		ret = image_load_raw(img, fd, buf.st_size);
+		close(fd);
+	}
+
+	if (ret)
+		image_free(img);
+
+	return ret;
+}
+
+void image_free(struct image *img)
+{
+	unsigned int i;
+
+	if (img->map)
+		munmap(img->map, img->map_len);
+	else {
+		for (i = 0; i < img->num_segs; i++)
+			free(img->segs[i].data);
+	}
+	free(img->segs);
+
+	memset(img, 0, sizeof(*img));
+}
+
+uint32_t image_end(const struct image *img)
+{
+	const struct image_segment *seg;
+
+	if (!img->num_segs)
+		return 0;
+
+	seg = &img->segs[img->num_segs - 1];
+
+	return seg->addr + seg->len;
+}
+
+uint8_t image_get_byte(const struct image *img, uint32_t addr)
+{
+	const struct image_segment *seg;
+	unsigned int lo, hi, mid;
+
+	lo = 0;
+	hi = img->num_segs;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		seg = &img->segs[mid];
+		if (addr < seg->addr)
+			hi = mid;
+		else if (addr - seg->addr >= seg->len)
+			lo = mid + 1;
+		else
+			return seg->data[addr - seg->addr];
+	}
+
+	return 0xFF;
+}
+
+/*
+ * Add data at addr to an image built in memory, it must not overlap
+ * what the image already holds
+ */
+int image_add(struct image *img, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+	if (img->map) {
+		fprintf(stderr, "cannot add data to a mapped image\n");
+		return -1;
+	}
+
+	if (image_add_data(img, addr, data, len))
+		return -1;
+
+	return image_sort(img);
+}
+
+/*
+ * Copy the populated bytes of a flash range over buf, the bytes of the
+ * gaps between segments are left untouched
+ */
+void image_overlay(const struct image *img, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+	const struct image_segment *seg;
+	uint32_t start, end;
+	unsigned int n;
+
+	for (n = 0; n < img->num_segs; n++) {
+		seg = &img->segs[n];
+		if (seg->addr >= addr + len || seg->addr + seg->len <= addr)
+			continue;
+
+		start = addr > seg->addr ? addr - seg->addr : 0;
+		end = addr + len - seg->addr;
+		if (end > seg->len)
+			end = seg->len;
+
+		memcpy(buf + (seg->addr + start - addr), seg->data + start, end - start);
+	}
+}
+
+/*
+ * Copy a flash range, gaps between segments read as erased flash
+ */
+void image_read(const struct image *img, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+	memset(buf, 0xFF, len);
+	image_overlay(img, addr, buf, len);
+}
+
+/*
+ * Check whether the image populates any byte of a flash range
+ */
+bool image_overlaps(const struct image *img, uint32_t addr, uint32_t len)
+{
+	const struct image_segment *seg;
+	unsigned int n;
+
+	for (n = 0; n < img->num_segs; n++) {
+		seg = &img->segs[n];
+		if (seg->addr < addr + len && seg->addr + seg->len > addr)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Check whether a flash range would be left erased by the image
+ */
+bool image_is_blank(const struct image *img, uint32_t addr, uint32_t len)
+{
+	const struct image_segment *seg;
+	uint32_t start, end, i;
+	unsigned int n;
+
+	for (n = 0; n < img->num_segs; n++) {
+		seg = &img->segs[n];
+		if (seg->addr >= addr + len || seg->addr + seg->len <= addr)
+			continue;
+
+		start = addr > seg->addr ? addr - seg->addr : 0;
+		end = addr + len - seg->addr;
+		if (end > seg->len)
+			end = seg->len;
+
+		for (i = start; i < end; i++) {
+			if (seg->data[i] != 0xFF)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+
+	return crc;
+}
+
+uint32_t image_crc32(const struct image *img)
+{
+	const struct image_segment *seg;
+	uint32_t crc = 0xFFFFFFFF;
+	uint8_t hdr[8];
+	unsigned int n;
+
+	for (n = 0; n < img->num_segs; n++) {
+		seg = &img->segs[n];
+		hdr[0] = seg->addr >> 24;
+		hdr[1] = seg->addr >> 16;
+		hdr[2] = seg->addr >> 8;
+		hdr[3] = seg->addr;
+		hdr[4] = seg->len >> 24;
+		hdr[5] = seg->len >> 16;
+		hdr[6] = seg->len >> 8;
+		hdr[7] = seg->len;
+		crc = crc32_update(crc, hdr, sizeof(hdr));
+		crc = crc32_update(crc, seg->data, seg->len);
+	}
+
+	return ~crc;
+}
@@ -0,0 +1,42 @@
+#ifndef __CC2530PROG_IMAGE_H
+#define __CC2530PROG_IMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Firmware image: a list of populated flash ranges sorted by address,
+ * everything outside of them is left erased (0xFF). Once loaded, an
+ * image is only read and can be shared by several programming threads.
+ */
+struct image_segment {
+	uint32_t addr;
+	uint32_t len;
+	uint8_t *data;
+};
+
+struct image {
+	struct image_segment *segs;
+	unsigned int num_segs;
+
+	/* read-only file mapping backing the segments, if any */
+	void *map;
+	size_t map_len;
+};
+
+int image_load(struct image *img, const char *path);
+/* images built in memory start zeroed, e.g. per-device patches */
+int image_add(struct image *img, uint32_t addr, const uint8_t *data, uint32_t len);
+void image_free(struct image *img);
+
+uint32_t image_end(const struct image *img);
+uint8_t image_get_byte(const struct image *img, uint32_t addr);
+void image_read(const struct image *img, uint32_t addr, uint8_t *buf, uint32_t len);
+void image_overlay(const struct image *img, uint32_t addr, uint8_t *buf, uint32_t len);
+bool image_overlaps(const struct image *img, uint32_t addr, uint32_t len);
+bool image_is_blank(const struct image *img, uint32_t addr, uint32_t len);
+/* CRC-32 of the segments, addresses included, to tell images apart */
+uint32_t image_crc32(const struct image *img);
+
+#endif /* __CC2530PROG_IMAGE_H */
@@ -0,0 +1,196 @@
+/*
+ * Real-time scheduling, CPU pinning and memory locking
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+
+/*
+ * Below the threaded interrupt handlers (50 by default), which the GPIO
+ * controller or the storage the image comes from may depend on
+ */
+#define RT_PRIORITY		49
+
+#define CPUFREQ_GOVERNOR	"/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor"
+
+/* scheduling and affinity of the thread before rt_thread_enter() */
+static __thread struct {
+	bool fifo;
+	int policy;
+	struct sched_param param;
+	bool pinned;
+	cpu_set_t affinity;
+} saved;
+
+int rt_pick_cpu(int first, unsigned int n)
+{
+	cpu_set_t set;
+	int cpu, count;
+
+	if (first < 0)
+		first = sched_getcpu();
+	if (first < 0)
+		first = 0;
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		return first + n;
+
+	count = CPU_COUNT(&set);
+	if (!count)
+		return first;
+
+	/* walk the allowed CPUs from first, wrapping around */
+	n %= count;
+	for (cpu = first; ; cpu = (cpu + 1) % CPU_SETSIZE) {
+		if (CPU_ISSET(cpu, &set) && !n--)
+			return cpu;
+	}
+}
+
+static int cpufreq_read(int cpu, char *governor, size_t len)
+{
+	char path[64];
+	FILE *fp;
+	int ret = -1;
+
+	snprintf(path, sizeof(path), CPUFREQ_GOVERNOR, cpu);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	if (fgets(governor, len, fp)) {
+		governor[strcspn(governor, "\n")] = '\0';
+		ret = 0;
+	}
+	fclose(fp);
+
+	return ret;
+}
+
+static int cpufreq_write(int cpu, const char *governor)
+{
+	char path[64];
+	FILE *fp;
+	int ret;
+
+	snprintf(path, sizeof(path), CPUFREQ_GOVERNOR, cpu);
+	fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+
+	ret = fputs(governor, fp) < 0 ? -1 : 0;
+	if (fclose(fp))
+		ret = -1;
+
+	return ret;
+}
+
+void rt_process_enter(struct rt_process *s, const int *cpus, unsigned int num_cpus,
+		      bool cpufreq)
+{
+	unsigned int i, j;
+
+	memset(s, 0, sizeof(*s));
+
+	/* no page fault in the middle of a burst */
+	if (mlockall(MCL_CURRENT | MCL_FUTURE))
+		perror("mlockall");
+	else
+		s->locked = true;
+
+	if (!cpufreq)
+		return;
+
+	for (i = 0; i < num_cpus && s->num_cpus < RT_MAX_CPUS; i++) {
+		for (j = 0; j < s->num_cpus; j++) {
+			if (s->cpufreq[j].cpu == cpus[i])
+				break;
+		}
+		if (j < s->num_cpus)
+			continue;
+
+		if (cpufreq_read(cpus[i], s->cpufreq[j].governor,
+				 sizeof(s->cpufreq[j].governor))) {
+			fprintf(stderr, "CPU %d has no cpufreq governor\n", cpus[i]);
+			continue;
+		}
+
+		if (strcmp(s->cpufreq[j].governor, "performance") &&
+		    cpufreq_write(cpus[i], "performance")) {
+			fprintf(stderr, "cannot set the performance governor of CPU %d\n",
+					cpus[i]);
+			continue;
+		}
+
+		s->cpufreq[j].cpu = cpus[i];
+		s->num_cpus++;
+	}
+}
+
+void rt_process_leave(struct rt_process *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < s->num_cpus; i++) {
+		if (strcmp(s->cpufreq[i].governor, "performance") &&
+		    cpufreq_write(s->cpufreq[i].cpu, s->cpufreq[i].governor))
+			fprintf(stderr, "cannot restore the %s governor of CPU %d\n",
+					s->cpufreq[i].governor, s->cpufreq[i].cpu);
+	}
+	s->num_cpus = 0;
+
+	if (s->locked)
+		munlockall();
+	s->locked = false;
+}
+
+void rt_thread_enter(int cpu)
+{
+	struct sched_param param = { .sched_priority = RT_PRIORITY };
+	cpu_set_t set;
+	int err;
+
+	saved.pinned = false;
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_getaffinity(0, sizeof(saved.affinity), &saved.affinity) ||
+		    sched_setaffinity(0, sizeof(set), &set))
+			fprintf(stderr, "cannot pin to CPU %d: %s\n", cpu, strerror(errno));
+		else
+			saved.pinned = true;
+	}
+
+	saved.fifo = false;
+	err = pthread_getschedparam(pthread_self(), &saved.policy, &saved.param);
+	if (!err)
+		err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err)
+		fprintf(stderr, "cannot switch to SCHED_FIFO: %s\n", strerror(err));
+	else
+		saved.fifo = true;
+}
+
+void rt_thread_leave(void)
+{
+	if (saved.fifo)
+		pthread_setschedparam(pthread_self(), saved.policy, &saved.param);
+	saved.fifo = false;
+
+	if (saved.pinned)
+		sched_setaffinity(0, sizeof(saved.affinity), &saved.affinity);
+	saved.pinned = false;
+}
@@ -0,0 +1,42 @@
+#ifndef __CC2530PROG_RT_H
+#define __CC2530PROG_RT_H
+
+#include <stdbool.h>
+
+/*
+ * Real-time execution of the bit-banging threads, on a best effort
+ * basis: what cannot be applied (usually for lack of privileges) is
+ * reported on stderr and programming goes on without it. Everything is
+ * put back as it was when leaving.
+ */
+#define RT_MAX_CPUS		16
+
+/* process-wide: locked memory and the governor of the CPUs used */
+struct rt_process {
+	bool locked;
+	unsigned int num_cpus;
+	struct {
+		int cpu;
+		char governor[32];
+	} cpufreq[RT_MAX_CPUS];
+};
+
+/*
+ * The n-th CPU the calling thread may run on, counting from first, or
+ * from the current CPU if first is negative
+ */
+int rt_pick_cpu(int first, unsigned int n);
+
+/* lock the memory, and select the performance governor of cpus if cpufreq */
+void rt_process_enter(struct rt_process *s, const int *cpus, unsigned int num_cpus,
+		      bool cpufreq);
+void rt_process_leave(struct rt_process *s);
+
+/*
+ * Make the calling thread SCHED_FIFO, pinned to cpu unless negative,
+ * until it calls rt_thread_leave()
+ */
+void rt_thread_enter(int cpu);
+void rt_thread_leave(void);
+
+#endif /* __CC2530PROG_RT_H */
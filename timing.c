@@ -0,0 +1,160 @@
+/*
+ * Debug clock pacing
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "timing.h"
+
+/* half periods from this one on sleep instead of spinning */
+#define TIMING_SLEEP_NS		50000
+
+#define TIMING_CAL_LOOPS	1000000
+
+/* polls done back to back before backing off, and the back-off bounds */
+#define TIMING_SPIN_POLLS	2
+#define TIMING_MIN_DELAY_US	10
+#define TIMING_MAX_DELAY_US	1000
+
+unsigned long timing_pace;
+static unsigned long timing_hz;
+
+/* busy-wait loop iterations per second, measured once */
+static uint64_t loops_per_sec;
+
+static void timing_spin(unsigned long loops)
+{
+	volatile unsigned long i;
+
+	for (i = 0; i < loops; i++)
+		;
+}
+
+uint64_t timing_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void timing_calibrate(void)
+{
+	uint64_t start, elapsed;
+
+	start = timing_now_ns();
+	timing_spin(TIMING_CAL_LOOPS);
+	elapsed = timing_now_ns() - start;
+
+	if (!elapsed)
+		elapsed = 1;
+
+	loops_per_sec = TIMING_CAL_LOOPS * 1000000000ULL / elapsed;
+}
+
+int timing_set_clock(unsigned long hz)
+{
+	unsigned long half_ns, loops, pace;
+
+	if (!hz) {
+		__atomic_store_n(&timing_pace, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&timing_hz, 0, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	if (!loops_per_sec)
+		timing_calibrate();
+
+	/* round the half period up, never clock faster than asked */
+	half_ns = (1000000000UL + 2 * hz - 1) / (2 * hz);
+	if (half_ns < TIMING_SLEEP_NS) {
+		loops = (loops_per_sec + 2 * hz - 1) / (2 * hz);
+		if (!loops)
+			loops = 1;
+		pace = loops << 1;
+	} else
+		pace = (half_ns << 1) | TIMING_PACE_SLEEP;
+
+	__atomic_store_n(&timing_pace, pace, __ATOMIC_RELAXED);
+	__atomic_store_n(&timing_hz, hz, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+unsigned long timing_get_clock(void)
+{
+	return __atomic_load_n(&timing_hz, __ATOMIC_RELAXED);
+}
+
+static void timing_sleep_ns(unsigned long ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000UL;
+	ts.tv_nsec = ns % 1000000000UL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR)
+		;
+}
+
+void timing_wait(unsigned long pace)
+{
+	if (pace & TIMING_PACE_SLEEP)
+		timing_sleep_ns(pace >> 1);
+	else
+		timing_spin(pace >> 1);
+}
+
+void timing_sleep_us(unsigned long us)
+{
+	timing_sleep_ns(us * 1000);
+}
+
+void timing_wait_start(struct timing_deadline *d, unsigned long expected_us,
+		       unsigned long timeout_ms)
+{
+	d->deadline_ns = timing_now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+	d->polls = 0;
+
+	/*
+	 * the poll interval grows from an eighth to a quarter of the latency,
+	 * within the back-off bounds
+	 */
+	d->max_delay_us = expected_us / 4;
+	if (d->max_delay_us > TIMING_MAX_DELAY_US)
+		d->max_delay_us = TIMING_MAX_DELAY_US;
+	if (d->max_delay_us < TIMING_MIN_DELAY_US)
+		d->max_delay_us = TIMING_MIN_DELAY_US;
+	d->delay_us = expected_us / 8;
+	if (d->delay_us < TIMING_MIN_DELAY_US)
+		d->delay_us = TIMING_MIN_DELAY_US;
+	if (d->delay_us > d->max_delay_us)
+		d->delay_us = d->max_delay_us;
+
+	if (expected_us)
+		timing_sleep_us(expected_us - expected_us / 4);
+}
+
+int timing_wait_poll(struct timing_deadline *d)
+{
+	if (timing_now_ns() > d->deadline_ns)
+		return -ETIMEDOUT;
+
+	if (d->polls++ < TIMING_SPIN_POLLS)
+		return 0;
+
+	timing_sleep_us(d->delay_us);
+
+	d->delay_us *= 2;
+	if (d->delay_us > d->max_delay_us)
+		d->delay_us = d->max_delay_us;
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef __CC2530PROG_TIMING_H
+#define __CC2530PROG_TIMING_H
+
+#include <stdint.h>
+
+/*
+ * Debug clock pacing for the bit-banged backends: every CCLK edge is
+ * followed by a half period wait, so that the clock never runs faster
+ * than requested, whatever the speed of the GPIO accesses.
+ *
+ * The threads of every target read the half period while a clock
+ * back-off may rewrite it, so it is published as a single word: 0
+ * disables pacing, otherwise the upper bits are nanoseconds to sleep
+ * when TIMING_PACE_SLEEP is set, or busy-wait loops to spin.
+ */
+extern unsigned long timing_pace;
+
+#define TIMING_PACE_SLEEP	1UL
+
+/* limit the clock to hz, 0 disables pacing */
+int timing_set_clock(unsigned long hz);
+unsigned long timing_get_clock(void);
+
+void timing_wait(unsigned long pace);
+
+static inline void timing_edge(void)
+{
+	unsigned long pace = __atomic_load_n(&timing_pace, __ATOMIC_RELAXED);
+
+	if (pace)
+		timing_wait(pace);
+}
+
+/*
+ * Waiting for the target: the first part of the expected duration of
+ * the operation is slept through, then the target is polled with an
+ * exponentially growing interval until it is done or the deadline, in
+ * wall-clock time, has passed.
+ */
+struct timing_deadline {
+	uint64_t deadline_ns;
+	unsigned long delay_us;
+	unsigned long max_delay_us;
+	unsigned int polls;
+};
+
+uint64_t timing_now_ns(void);
+void timing_sleep_us(unsigned long us);
+
+void timing_wait_start(struct timing_deadline *d, unsigned long expected_us,
+		       unsigned long timeout_ms);
+/* call before each new poll, returns -ETIMEDOUT past the deadline */
+int timing_wait_poll(struct timing_deadline *d);
+
+#endif /* __CC2530PROG_TIMING_H */
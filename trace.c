@@ -0,0 +1,160 @@
+/*
+ * Debug link instrumentation
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "trace.h"
+#include "timing.h"
+
+/* must be a power of 2 */
+#define TRACE_RING_LEN		256
+#define TRACE_RING_BYTES	4
+
+/* 0, 1, 2-3, 4-7, ... polls */
+#define TRACE_HIST_BUCKETS	12
+
+struct trace_entry {
+	uint64_t seq;		/* 0 while being written */
+	uint64_t ns;
+	int pin;
+	int ret;
+	unsigned int polls;
+	uint16_t out_len;
+	uint16_t in_len;
+	uint8_t out[TRACE_RING_BYTES];
+	uint8_t in[TRACE_RING_BYTES];
+};
+
+static unsigned long cmd_counters[TRACE_NUM_CMDS][TRACE_NUM_EVENTS];
+static unsigned long ready_hist[TRACE_HIST_BUCKETS];
+
+static struct trace_entry ring[TRACE_RING_LEN];
+static uint64_t ring_head;
+
+/* ready-wait polls of this thread since its last traced transaction */
+static __thread unsigned int pending_polls;
+
+static const char * const event_names[TRACE_NUM_EVENTS] = {
+	[TRACE_ISSUED]		= "issued",
+	[TRACE_RETRIED]		= "retried",
+	[TRACE_TIMEDOUT]	= "timed out",
+};
+
+void trace_cmd(uint8_t id, enum trace_event event)
+{
+	__atomic_fetch_add(&cmd_counters[id >> 3][event], 1, __ATOMIC_RELAXED);
+}
+
+void trace_ready(unsigned int polls)
+{
+	unsigned int bucket = 0;
+
+	while (polls >> bucket && bucket < TRACE_HIST_BUCKETS - 1)
+		bucket++;
+
+	__atomic_fetch_add(&ready_hist[bucket], 1, __ATOMIC_RELAXED);
+	pending_polls += polls;
+}
+
+static size_t trace_min(size_t len)
+{
+	return len < TRACE_RING_BYTES ? len : TRACE_RING_BYTES;
+}
+
+void trace_xfer(int pin, const uint8_t *out, size_t out_len,
+		const uint8_t *in, size_t in_len, int ret)
+{
+	uint64_t seq = __atomic_add_fetch(&ring_head, 1, __ATOMIC_RELAXED);
+	struct trace_entry *e = &ring[seq & (TRACE_RING_LEN - 1)];
+
+	__atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	e->ns = timing_now_ns();
+	e->pin = pin;
+	e->ret = ret;
+	e->polls = pending_polls;
+	e->out_len = out_len;
+	e->in_len = in_len;
+	memset(e->out, 0, sizeof(e->out));
+	memset(e->in, 0, sizeof(e->in));
+	if (out)
+		memcpy(e->out, out, trace_min(out_len));
+	if (in)
+		memcpy(e->in, in, trace_min(in_len));
+
+	__atomic_store_n(&e->seq, seq, __ATOMIC_RELEASE);
+	pending_polls = 0;
+}
+
+static void trace_dump_bytes(FILE *f, const uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < trace_min(len); i++)
+		fprintf(f, " %02x", buf[i]);
+	if (len > TRACE_RING_BYTES)
+		fprintf(f, " ...");
+}
+
+void trace_dump(FILE *f, const char *const names[TRACE_NUM_CMDS])
+{
+	uint64_t head, seq, first_ns = 0;
+	struct trace_entry e, *slot;
+	unsigned int i, j;
+
+	fprintf(f, "debug commands:\n");
+	for (i = 0; i < TRACE_NUM_CMDS; i++) {
+		if (!cmd_counters[i][TRACE_ISSUED])
+			continue;
+		fprintf(f, "\t%-12s", names[i] ? names[i] : "?");
+		for (j = 0; j < TRACE_NUM_EVENTS; j++)
+			fprintf(f, " %s %lu", event_names[j], cmd_counters[i][j]);
+		fprintf(f, "\n");
+	}
+
+	fprintf(f, "ready-wait polls:\n");
+	for (i = 0; i < TRACE_HIST_BUCKETS; i++) {
+		if (!ready_hist[i])
+			continue;
+		if (i < 2)
+			fprintf(f, "\t%u: %lu\n", i, ready_hist[i]);
+		else if (i < TRACE_HIST_BUCKETS - 1)
+			fprintf(f, "\t%u-%u: %lu\n", 1 << (i - 1), (1 << i) - 1, ready_hist[i]);
+		else
+			fprintf(f, "\t%u+: %lu\n", 1 << (i - 1), ready_hist[i]);
+	}
+
+	head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+	seq = head >= TRACE_RING_LEN ? head - TRACE_RING_LEN + 1 : 1;
+
+	fprintf(f, "last transactions (us, pin, request, answer, polls, result):\n");
+	for (; seq <= head; seq++) {
+		slot = &ring[seq & (TRACE_RING_LEN - 1)];
+
+		/* skip entries overwritten or being written meanwhile */
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq)
+			continue;
+		e = *slot;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+
+		if (!first_ns)
+			first_ns = e.ns;
+
+		fprintf(f, "\t%10.1f %3d", (e.ns - first_ns) / 1e3, e.pin);
+		trace_dump_bytes(f, e.out, e.out_len);
+		fprintf(f, " ->");
+		trace_dump_bytes(f, e.in, e.in_len);
+		fprintf(f, " (%u polls) %d\n", e.polls, e.ret);
+	}
+}
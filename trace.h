@@ -0,0 +1,63 @@
+#ifndef __CC2530PROG_TRACE_H
+#define __CC2530PROG_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Debug link instrumentation, built with TRACE defined (make TRACE=1):
+ * - counters of the debug commands issued, retried and timed out,
+ *   indexed by command id >> 3;
+ * - a histogram of the ready-wait polls of each transaction, reported
+ *   by the GPIO backends;
+ * - a ring of the last transactions, dumped when something fails.
+ * Everything is lock-free and can be used by all the target threads.
+ * Without TRACE, all of it compiles to nothing.
+ */
+enum trace_event {
+	TRACE_ISSUED,
+	TRACE_RETRIED,
+	TRACE_TIMEDOUT,
+	TRACE_NUM_EVENTS,
+};
+
+#define TRACE_NUM_CMDS		32
+
+#ifdef TRACE
+void trace_cmd(uint8_t id, enum trace_event event);
+void trace_ready(unsigned int polls);
+void trace_xfer(int pin, const uint8_t *out, size_t out_len,
+		const uint8_t *in, size_t in_len, int ret);
+void trace_dump(FILE *f, const char *const names[TRACE_NUM_CMDS]);
+#else
+static inline void trace_cmd(uint8_t id, enum trace_event event)
+{
+	(void)id;
+	(void)event;
+}
+
+static inline void trace_ready(unsigned int polls)
+{
+	(void)polls;
+}
+
+static inline void trace_xfer(int pin, const uint8_t *out, size_t out_len,
+			      const uint8_t *in, size_t in_len, int ret)
+{
+	(void)pin;
+	(void)out;
+	(void)out_len;
+	(void)in;
+	(void)in_len;
+	(void)ret;
+}
+
+static inline void trace_dump(FILE *f, const char *const names[TRACE_NUM_CMDS])
+{
+	(void)f;
+	(void)names;
+}
+#endif
+
+#endif /* __CC2530PROG_TRACE_H */
@@ -0,0 +1,152 @@
+/*
+ * SPI transport for the debug port using the Linux spidev interface
+ *
+ * Copyright (C) 2010, Florian Fainelli <f.fainelli@gmail.com>
+ *
+ * This file is part of "cc2530prog", this file is distributed under
+ * a 2-clause BSD license, see LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "gpio.h"
+#include "timing.h"
+
+#ifndef SPIDEV_SPEED_HZ
+#define SPIDEV_SPEED_HZ		1000000
+#endif
+
+/* default spidev buffer size, see the spidev "bufsiz" module parameter */
+#define SPIDEV_MAX_XFER		4096
+
+/*
+ * SCLK and MOSI are wired to the CCLK and DATA lines, in parallel with
+ * the CCLK and DATA GPIOs. Everything the host sends (command bytes and
+ * burst payloads) is clocked out by the SPI controller while the two
+ * GPIOs are released, the GPIOs are used for the DATA turnaround, the
+ * ready-wait sampling and reading back the answers.
+ */
+static int spi_fd = -1;
+static int spi_cclk = -1;
+
+int gpio_transport_init(const struct board *board)
+{
+	uint32_t speed = SPIDEV_SPEED_HZ;
+	uint8_t bits = 8;
+	uint8_t mode;
+
+	if (!board->spidev) {
+		fprintf(stderr, "board %s has no SPI device\n", board->name);
+		return -1;
+	}
+
+	spi_cclk = board->cclk;
+
+	spi_fd = open(board->spidev, O_RDWR);
+	if (spi_fd < 0) {
+		perror(board->spidev);
+		return -1;
+	}
+
+	/*
+	 * The target samples DATA on the falling edge of CCLK, which idles
+	 * low: this is SPI mode 1, MSB first. There is no chip select.
+	 */
+	mode = SPI_MODE_1 | SPI_NO_CS;
+	if (ioctl(spi_fd, SPI_IOC_WR_MODE, &mode) < 0) {
+		mode = SPI_MODE_1;
+		if (ioctl(spi_fd, SPI_IOC_WR_MODE, &mode) < 0) {
+			perror("SPI_IOC_WR_MODE");
+			goto out_close;
+		}
+	}
+
+	if (ioctl(spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0) {
+		perror("SPI_IOC_WR_BITS_PER_WORD");
+		goto out_close;
+	}
+
+	if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+		perror("SPI_IOC_WR_MAX_SPEED_HZ");
+		goto out_close;
+	}
+
+	return 0;
+
+out_close:
+	close(spi_fd);
+	spi_fd = -1;
+	return -1;
+}
+
+/*
+ * The SPI controller clocks the bytes sent to the target at hz (its
+ * default speed for 0), the GPIO driven edges are paced in software.
+ */
+int gpio_set_clock(unsigned long hz)
+{
+	uint32_t speed = hz ? hz : SPIDEV_SPEED_HZ;
+
+	if (ioctl(spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+		perror("SPI_IOC_WR_MAX_SPEED_HZ");
+		return -1;
+	}
+
+	return timing_set_clock(hz);
+}
+
+void gpio_transport_exit(void)
+{
+	if (spi_fd >= 0)
+		close(spi_fd);
+	spi_fd = -1;
+}
+
+int gpio_shift_out(int cclk, int data, const uint8_t *buf, size_t len)
+{
+	struct spi_ioc_transfer xfer;
+	size_t chunk;
+	int ret = 0;
+
+	/* there is only one SPI bus, wired to the board CCLK/DATA lines */
+	if (cclk != spi_cclk) {
+		fprintf(stderr, "spidev: CCLK %d is not wired to the SPI bus\n", cclk);
+		return -1;
+	}
+
+	/* hand the lines over to the SPI controller */
+	if (gpio_set_direction(cclk, GPIO_DIRECTION_IN) ||
+	    gpio_set_direction(data, GPIO_DIRECTION_IN))
+		return -1;
+
+	while (len) {
+		chunk = len < SPIDEV_MAX_XFER ? len : SPIDEV_MAX_XFER;
+
+		memset(&xfer, 0, sizeof(xfer));
+		xfer.tx_buf = (unsigned long)buf;
+		xfer.len = chunk;
+
+		if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
+			perror("SPI_IOC_MESSAGE");
+			ret = -1;
+			break;
+		}
+
+		buf += chunk;
+		len -= chunk;
+	}
+
+	/* and take them back, CCLK idles low */
+	if (gpio_set_direction(cclk, GPIO_DIRECTION_OUT) ||
+	    gpio_set_direction(data, GPIO_DIRECTION_OUT))
+		return -1;
+
+	return ret;
+}